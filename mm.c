@@ -3,288 +3,4280 @@
  */
 
 /*
- * mm.c - A malloc allocator package implemented based on an implicit free list
+ * mm.c - A malloc allocator package implemented based on segregated explicit free lists
  * 
- * In this approach, a block is allocated by setting its header and footer to corresponding sizes
- *  There are headers or footers.  Blocks are immediately coalesced or reused. 
- *  Realloc is optimized based on the least copying possible policy
+ * In this approach, a block is allocated by setting its header to the corresponding size
+ *  Only free blocks keep a footer: bit 1 of every header records whether the previous block
+ *  is allocated, so allocated blocks can use the footer word as payload.  Blocks are immediately
+ *  coalesced or reused. 
+ *  Realloc is optimized based on the least copying possible policy: a block shrinks in place,
+ *  grows into a free successor, the end of the heap or a free predecessor, and only then
+ *  moves; a block that has to move for a small growth takes half as much again, so that a
+ *  buffer grown a little at a time is copied O(log n) times.
  *  
- * A block is split when necessary to enable larger utilization, and a next-fit approach is used to increase
- * throughput
+ * Free blocks carry next/prev links in the first two words of their payload and are kept in
+ * size-class bins of two levels, as in TLSF: powers of two, each split into SL_COUNT classes
+ * of equal width, so a fit search only visits free blocks of a suitable class.
+ * Free blocks of TREE_MIN bytes and more use the same two words as child links of a treap
+ * keyed by (size, address) instead, so a large request finds its best fit in O(log n).
+ * A block is split when necessary to enable larger utilization.  The placement policy (first fit,
+ * next fit, best fit or address-ordered best fit) is set with mm_mallopt and only ever searches
+ * the class of the request: a two-level bitmap of non-empty classes finds the next class up,
+ * whose blocks all fit, with two ctz.  The treap always gives an address-ordered best fit.
  *
- * OPTIMIZATION DONE: a next fit approach is utilized and optimized mm_reaclloc to prevent copying the original content
+ * The heap is made of segments, runs of whole pages each owned by one arena and framed by
+ * its own prologue and epilogue.  An arena owns its free lists and grows its last segment in
+ * place while it still holds the break, or starts a new one when another arena took it.
+ * Built with MM_THREADS, threads are spread over MM_NARENAS arenas, each behind its own
+ * lock, and every thread keeps a small cache of recently freed blocks per size class that
+ * it reuses without taking any lock.  A block freed by a thread of another arena is pushed
+ * on that arena's remote-free list with one CAS, and the owner frees the list in one go the
+ * next time it takes its lock.
+ *
+ * Requests of at most SLAB_MAX bytes are served by a slab front end: objects of one size class,
+ * a power of two from ALIGNMENT bytes, are carved out of page-sized runs and carry no header at all.  A page map records which heap
+ * pages are runs, so a free finds the run of an object and returns its slot in O(1).
+ *
+ * Requests of at least the mmap threshold (128 KiB unless set with mm_mallopt) bypass the heap:
+ * each gets its own mapping, flagged in its header, which mm_free unmaps and mm_realloc
+ * resizes with mremap instead of copying.
+ *
+ * Free blocks of at least the trim threshold give their whole interior pages back to the OS
+ * with madvise, and mm_trim does the same for every free block on demand.  The break is never
+ * lowered, since mem_sbrk cannot shrink the heap; the address space stays but not the memory.
+ *
+ * Built with MM_64BIT, header, footer and link words are 64 bits wide and payloads 16-byte
+ * aligned, so blocks and heaps can exceed 4 GiB; slab objects stay header-less either way, in
+ * classes from 16 bytes so that they are 16-byte aligned too.
+ *
+ * mm_get_stats reports the heap and free space at any time; built with MM_STATS, cheap
+ * counters on every operation add live bytes, fit-search lengths, heap growth and the
+ * branches mm_realloc takes.
+ *
+ * Built with MM_TLSF, the package is a real-time Two-Level Segregated Fit allocator behind the
+ * same interface.  Every arena reserves (and faults in) a pool of MM_TLSF_POOL bytes when it is
+ * first used and never grows, the classes cover the whole pool, and a fit takes the head of
+ * the first non-empty class whose blocks all fit, found with two ctz.  There are no slabs,
+ * mappings, page releases or placement policies, so malloc, free and realloc run in bounded
+ * time apart from the copy of a moving realloc.
+ *
+ * Built with MM_GUARD, one request of at most a page in about MM_GUARD_RATE gets a page of its
+ * own, out of a pool where every page is followed by an inaccessible guard page.  The block ends
+ * against the guard page, so an overflow faults at once, and canary bytes fill the rest of the
+ * page, checked by mm_free and mm_realloc.  A freed page is poisoned and made inaccessible and
+ * waits behind the other free pages before it is used again.
+ *
+ * Built with MM_PROF, a block is sampled about every 512 KiB allocated: its call stack is
+ * captured and the block recorded in a side table until it is freed, and mm_prof_dump writes
+ * the live bytes by stack as a pprof heap profile.
+ *
+ * Blocks from mm_halloc are reached through a handle instead of a pointer, and mm_compact slides
+ * those not pinned down into the free blocks before them, so that free space gathers at the top
+ * of each segment, where its pages go back to the OS.
+ *
+ * Built with MM_NUMA, arena i belongs to NUMA node i % (number of nodes): the pages of its
+ * segments are bound to that node before they are first touched, and a thread gets an arena
+ * of the node it first allocates on.  mm_malloc_onnode allocates from the arena of a given node.
+ *
+ * Built with MM_PERSIST, mm_init can map the heap from a file (mm_heap_file, or MM_HEAP_FILE in
+ * the environment) instead of sbrk.  Nothing in the heap depends on its address, so after
+ * mm_snapshot has synced it a later mm_init reattaches the file, blocks and free lists as they
+ * were, in the time it takes to map it.
+ *
+ * Built with MM_TRACE, mm_trace_start (or MM_TRACE_FILE in the environment at mm_init) records
+ * every malloc, free and realloc into a per-thread ring that a background thread writes to a
+ * file; mm_bench replays such files.
+ *
+ * OPTIMIZATION DONE: segregated free lists replace the implicit-list scan and optimized mm_reaclloc
+ * to prevent copying the original content
  */
+#define _GNU_SOURCE /*for mremap*/
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "mm_ext.h"
+#include "memlib.h"
+
+/*
+ * Build options, set them with -D on the compiler command line
+ *   MM_THREADS   1 to make the package thread-safe (link with -pthread)
+ *   MM_NARENAS   number of arenas threads are spread over when MM_THREADS is set
+ *   MM_64BIT     1 for 64-bit header/footer words and 16-byte alignment (blocks and heaps over 4 GiB)
+ *   MM_MAX_HEAP  largest heap the page map can describe (bytes)
+ *   MM_STATS     1 to keep the operation counters reported by mm_get_stats
+ *   MM_TRACE     1 to make mm_trace_start available (link with -pthread)
+ *   MM_TLSF      1 for the bounded-time TLSF engine on a fixed pool per arena
+ *   MM_TLSF_POOL bytes of that pool (less than 1 GiB)
+ *   MM_GUARD     1 to make sampled guarded allocations available (mm_mallopt MM_GUARD_RATE)
+ *   MM_GUARD_SLOTS guarded pages, the most sampled blocks live at a time
+ *   MM_PROF      1 to sample allocation stacks for mm_prof_dump (mm_mallopt MM_PROF_RATE)
+ *   MM_PERSIST   1 to make file heaps available (mm_heap_file, mm_snapshot)
+ *   MM_NUMA      1 to place every arena's pages on a NUMA node of its own (needs MM_THREADS)
+ */
+#ifndef MM_THREADS
+#define MM_THREADS 0
+#endif
+#if !MM_THREADS
+#undef MM_NARENAS
+#define MM_NARENAS 1
+#endif
+#ifndef MM_NARENAS
+#define MM_NARENAS 8
+#endif
+#if MM_NARENAS > 63
+#error "MM_NARENAS must be at most 63, see PAGE_ARENA"
+#endif
+#ifndef MM_64BIT
+#define MM_64BIT 0
+#endif
+#ifndef MM_STATS
+#define MM_STATS 0
+#endif
+#ifndef MM_TRACE
+#define MM_TRACE 0
+#endif
+#ifndef MM_TLSF
+#define MM_TLSF 0
+#endif
+#ifndef MM_GUARD
+#define MM_GUARD 0
+#endif
+#ifndef MM_GUARD_SLOTS
+#define MM_GUARD_SLOTS 256
+#endif
+#ifndef MM_PROF
+#define MM_PROF 0
+#endif
+#ifndef MM_PERSIST
+#define MM_PERSIST 0
+#endif
+#ifndef MM_NUMA
+#define MM_NUMA 0
+#endif
+#if MM_NUMA && !MM_THREADS
+#error "MM_NUMA needs MM_THREADS, nodes are served by arenas of their own"
+#endif
+#ifndef MM_TLSF_POOL
+#define MM_TLSF_POOL (64UL<<20)
+#endif
+#ifndef MM_MAX_HEAP
+#if MM_64BIT
+#define MM_MAX_HEAP (1ULL<<38)
+#else
+#define MM_MAX_HEAP (1ULL<<32) /*heap offsets and sizes must fit in a 32-bit word*/
+#endif
+#endif
+
+#if MM_THREADS || MM_TRACE
+#include <pthread.h>
+#endif
+#if MM_PROF
+#include <execinfo.h>
+#endif
+#if MM_TRACE || MM_PERSIST
+#include <fcntl.h>
+#endif
+#if MM_TRACE
+#include <errno.h>
+#include <time.h>
+#endif
+#if MM_PERSIST
+#include <sys/stat.h>
+#endif
+#if MM_NUMA
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if MM_THREADS
+#define LOCK(m) pthread_mutex_lock(m)
+#define UNLOCK(m) pthread_mutex_unlock(m)
+#else
+#define LOCK(m)
+#define UNLOCK(m)
+#endif
+
+/*Counters of mm_get_stats; threads bump the shared ones without any ordering*/
+#if MM_STATS && MM_THREADS
+#define STAT_ADD(field, n) __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+#elif MM_STATS
+#define STAT_ADD(field, n) (stats.field += (n))
+#else
+#define STAT_ADD(field, n)
+#endif
+#if MM_STATS
+#define STAT_PROBE(a) ((a)->probes++)
+#else
+#define STAT_PROBE(a)
+#endif
+
+
+/* Basic constants and macros */
+#if MM_64BIT
+typedef uint64_t word_t;
+#define WSIZE 8 /*Word and header/footer size (bytes) */
+#define DSIZE 16 /*Double word size (bytes) */
+#else
+typedef uint32_t word_t;
+#define WSIZE 4 /*Word and header/footer size (bytes) */
+#define DSIZE 8 /*Double word size (bytes) */
+#endif
+#define CHUNKSIZE (1<<12) /*Extend heap by this amount (bytes), at first*/
+#define GROW_MAX (1<<20) /*default cap of the growth step, which doubles with every extension*/
+
+#define MAX(x,y) ((x)>(y)?(x):(y))
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc) ((size) | (alloc))
+
+/*Header bit recording that the previous block in the heap is allocated */
+#define PREV_ALLOC 0x2
+/*Header bit of a block living in its own mapping instead of the heap */
+#define MMAPPED 0x4
+
+/*Read and write a word at address p */
+#define GET(p) (*(word_t *)(p))
+#define PUT(p, val) (*(word_t *)(p)=(val))
+/*Read the header of an allocated block without its arena lock: a thread of the arena may flip the prev-alloc bit meanwhile*/
+#define GET_SHARED(p) __atomic_load_n((word_t *)(p), __ATOMIC_RELAXED)
+
+/*Read the size and allocated fields from address p*/
+#define GET_SIZE(p) (GET(p) & ~(word_t)0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define GET_MMAPPED(p) (GET_SHARED(p) & MMAPPED)
+#define GET_SHARED_SIZE(p) (GET_SHARED(p) & ~(word_t)0x7)
+
+/*Set or clear the prev-alloc bit of the header at address p, under its arena lock; stored whole, since the block's owner may read the header unlocked*/
+#define SET_PREV_ALLOC(p) __atomic_store_n((word_t *)(p), GET(p) | PREV_ALLOC, __ATOMIC_RELAXED)
+#define CLR_PREV_ALLOC(p) __atomic_store_n((word_t *)(p), GET(p) & ~PREV_ALLOC, __ATOMIC_RELAXED)
+
+/*Given block ptr bp, compute address of its header and footer (only free blocks have a footer) */
+#define HDRP(bp) ((char*)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/*Given block ptr bp, compute address of next and previous blocks (PREV_BLKP only when the previous block is free) */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+#define ALIGNMENT DSIZE
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/*Largest request: its block must fit in a header word and leave room for segment framing in the heap*/
+#define MAX_REQUEST (MM_MAX_HEAP - 2*PAGE_SIZE)
+
+/*Bytes asked for when a block of old payload bytes has to move to hold size: 1.5 times old for a small growth*/
+#define REALLOC_GROW(old, size) ((size) > (old) && (size) < (old) + (old) / 2 ? (old) + (old) / 2 : (size))
+/*realloc copies of at least this many bytes bypass the cache, they would only evict the working set*/
+#define COPY_NT_MIN (1<<20)
+
+/*mem_sbrk takes an int, so the break grows by at most this much per call*/
+#define SBRK_STEP (1<<30)
+
+/*
+ * A mapped block: the mapping starts with a word holding the offset of the payload, then the
+ * header, whose size is the length of the whole mapping
+ */
+#define MMAP_THRESHOLD (128*1024)
+#define MMAP_OFFSET(bp) GET((char *)(bp) - DSIZE)
+#define MMAP_START(bp) ((char *)(bp) - MMAP_OFFSET(bp))
+
+/*Free blocks from this size on release their pages; the first payload bytes of a free block hold its links*/
+#define TRIM_THRESHOLD (128*1024)
+#define FREE_META (2*WSIZE)
+#ifdef MADV_FREE
+#define MADV_RELEASE MADV_FREE /*lazy: the kernel takes the pages only under memory pressure*/
+#else
+#define MADV_RELEASE MADV_DONTNEED
+#endif
+
+/*The heap grows in whole pages so that every page belongs to exactly one segment */
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1<<PAGE_SHIFT)
+#define PAGE_ALIGN(size) (((size) + (PAGE_SIZE-1)) & ~(size_t)(PAGE_SIZE-1))
+/*with huge pages on (MM_HUGEPAGE) the heap starts and grows in whole transparent huge pages*/
+#define HUGE_SIZE (1<<21)
+#define HUGE_ALIGN(size) (((size) + (HUGE_SIZE-1)) & ~(size_t)(HUGE_SIZE-1))
+#define HEAP_ALIGN(size) (hugepages ? HUGE_ALIGN(size) : PAGE_ALIGN(size))
+
+/*A segment starts with a word holding its arena id and the prologue block, and ends with the epilogue header */
+#define SEG_OVERHEAD (4*WSIZE)
+
+/*
+ * The page map keeps one byte per heap page: the id + 1 of the arena owning the page, a flag
+ * for pages that hold a slab run and one for pages where a sampled block of MM_PROF starts
+ */
+#define PAGE_MAP(p) (page_map[((char *)(p) - heap_base) >> PAGE_SHIFT])
+/*frees read the byte without a lock while its flags change under the arena or profile lock, so those accesses are atomic; the memsets only set up pages no pointer reaches yet*/
+#define PAGE_GET(p) __atomic_load_n(&PAGE_MAP(p), __ATOMIC_RELAXED)
+#define PAGE_SET(p, flag) __atomic_fetch_or(&PAGE_MAP(p), (flag), __ATOMIC_RELAXED)
+#define PAGE_CLR(p, flag) __atomic_fetch_and(&PAGE_MAP(p), (unsigned char)~(flag), __ATOMIC_RELAXED)
+#define PAGE_ARENA 0x3f
+#define PAGE_PROF 0x40
+#define PAGE_SLAB 0x80
+
+/*Slab size classes are the powers of two from ALIGNMENT to SLAB_MAX bytes, so every object keeps the payload alignment*/
+#define SLAB_MAX 128
+#if MM_64BIT
+#define SLAB_CLASSES 4
+#else
+#define SLAB_CLASSES 5
+#endif
+#define SLAB_SIZE(cls) (ALIGNMENT << (cls))
+
+/*A run is a page-aligned heap block whose payload is the page minus the next block's header*/
+#define SLAB_RUN(p) (heap_base + (((char *)(p) - heap_base) & ~(size_t)(PAGE_SIZE-1)))
+#define SLAB_END (PAGE_SIZE - WSIZE)
+#define SLAB_HDR ALIGN(sizeof(slab_t))
+#define SLAB_CAPACITY(cls) ((SLAB_END - SLAB_HDR) / SLAB_SIZE(cls))
+
+/*Is p inside the heap? Mapped blocks never are; the break moves under an arena lock while frees read it without one*/
+#define IN_HEAP(p) ((char *)(p) >= heap_base && (char *)(p) < __atomic_load_n(&heap_brk, __ATOMIC_RELAXED))
+
+/*Is p an object inside a slab run? Only heap pointers below the break can be*/
+#define IS_SLAB(p) (IN_HEAP(p) && (PAGE_GET(p) & PAGE_SLAB))
+
+/*
+ * Free-list classes: first level f holds free blocks of size [2^(f+4), 2^(f+5)), split into
+ * SL_COUNT second-level classes of equal width; class k = f*SL_COUNT + s, larger blocks are in the treap
+ */
+#if MM_TLSF
+/*every block of the pool has a class, so the treap stays empty*/
+#define FL_COUNT 26
+#define SL_SHIFT 4
+#if MM_TLSF_POOL >= (1UL << (FL_COUNT + 4))
+#error "MM_TLSF_POOL must be less than 1 GiB"
+#endif
+#else
+#define FL_COUNT 8
+#define SL_SHIFT 2
+#endif
+#define SL_COUNT (1 << SL_SHIFT)
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#define TREE_MIN (1 << (FL_COUNT + 4))
+
+/*Free-list links are heap offsets (0 means none) so a free block still fits in 2*DSIZE bytes */
+#define LINK_TO_PTR(off) ((off) ? heap_base + (off) : NULL)
+#define PTR_TO_LINK(p) ((p) ? (word_t)((char *)(p) - heap_base) : 0)
+
+/*Given free block ptr bp, read and write its successor and predecessor in its size class */
+#define NEXT_FREE(bp) LINK_TO_PTR(GET(bp))
+#define PREV_FREE(bp) LINK_TO_PTR(GET((char *)(bp) + WSIZE))
+#define SET_NEXT_FREE(bp, p) PUT(bp, PTR_TO_LINK(p))
+#define SET_PREV_FREE(bp, p) PUT((char *)(bp) + WSIZE, PTR_TO_LINK(p))
+
+/*Given free block ptr bp in the treap, read and write its children*/
+#define TREE_LEFT(bp) LINK_TO_PTR(GET(bp))
+#define TREE_RIGHT(bp) LINK_TO_PTR(GET((char *)(bp) + WSIZE))
+#define SET_TREE_LEFT(bp, p) PUT(bp, PTR_TO_LINK(p))
+#define SET_TREE_RIGHT(bp, p) PUT((char *)(bp) + WSIZE, PTR_TO_LINK(p))
+/*treap order: by size, then by address*/
+#define TREE_LESS(x, y) (GET_SIZE(HDRP(x)) < GET_SIZE(HDRP(y)) || (GET_SIZE(HDRP(x)) == GET_SIZE(HDRP(y)) && (char *)(x) < (char *)(y)))
+
+/*
+ * Header at the start of a slab run; free slots form a list threaded through their first
+ * two bytes, slots past bump have never been handed out
+ */
+typedef struct slab {
+    word_t next;                    /*heap offset of the next run of the class with free slots*/
+    word_t prev;
+    unsigned short cls;
+    unsigned short nfree;           /*number of free slots*/
+    unsigned short free;            /*offset in the run of the first free slot, 0 if none*/
+    unsigned short bump;            /*offset of the first never-used slot*/
+} slab_t;
+
+/*
+ * Fast bins: with deferred coalescing on (MM_FAST_MAX), blocks of up to fast_max bytes freed to
+ * an arena stay marked allocated, on a LIFO per size, until a consolidation frees them for real
+ */
+#define FAST_LIMIT 1024 /*largest fast_max accepted (bytes)*/
+#define FAST_BINS (FAST_LIMIT/DSIZE + 1)
+#define FAST_BYTES (256*1024) /*bytes held in the fast bins of an arena that trigger a consolidation*/
+
+/* An arena: the free-list state of a set of segments, what mm_init used to keep in globals */
+typedef struct arena {
+    char *heap_listp;               /*prologue block of the arena's first segment */
+    char *epilogue;                 /*epilogue header of the arena's last segment */
+    char *free_lists[NUM_CLASSES];  /*heads of the segregated free lists */
+    char *rovers[NUM_CLASSES];      /*where the next next-fit search of each class starts */
+    unsigned int fl_map;            /*bit f set while a class of first level f has a block */
+    unsigned int sl_map[FL_COUNT];  /*bit s of word f set while free list f*SL_COUNT + s has a block */
+    char *tree;                     /*root of the treap of free blocks of at least TREE_MIN bytes */
+    char *slabs[SLAB_CLASSES];      /*runs of every slab class that have free slots */
+    char *fast[FAST_BINS];          /*fast bin of every block size, linked through the first payload word */
+    size_t fast_bytes;              /*bytes held in the fast bins */
+    size_t grow;                    /*least the next heap extension asks for */
+    char *check_at;                 /*block mm_check_step resumes at in its current segment, see CHECK_MERGED */
+#if MM_THREADS
+    char *remote;                   /*blocks freed by other threads, pushed lock-free and drained under the lock */
+#endif
+    unsigned int id;
+#if MM_THREADS
+    pthread_mutex_t lock;
+#endif
+#if MM_STATS
+    unsigned long probes;           /*blocks the current fit search has looked at */
+#endif
+} arena_t;
+
+static arena_t arenas[MM_NARENAS];
+
+/*a merge swallowing the block at gone moves the incremental checker's cursor to the block it joined*/
+#define CHECK_MERGED(a, gone, into) do { if ((a)->check_at == (char *)(gone)) (a)->check_at = (char *)(into); } while (0)
+
+/*
+ * A region lives at the start of its first chunk and bump-allocates from cur to end. Further
+ * chunks, and the chunks of requests too large to share one, are blocks of the heap linked
+ * through their first word; a reset frees them and keeps the first chunk.
+ */
+#define REGION_CHUNK (64*1024) /*default chunk size (bytes)*/
+#define REGION_LINK ALIGN(sizeof(char *))
+
+struct mm_region {
+    char *chunks;                   /*chunks after the first, last allocated first*/
+    char *cur;                      /*next free byte of the current chunk*/
+    char *end;
+    size_t chunk_size;
+};
+
+/*start of the heap (page aligned), the origin of free-list links */
+static char *heap_base = 0;
+/*current break, only ever grows while the heap is in use */
+static char *heap_brk = 0;
+/*see PAGE_MAP*/
+static unsigned char *page_map;
+/*requests of at least this size are mapped on their own */
+static size_t mmap_threshold = MM_TLSF ? (size_t)-1 : MMAP_THRESHOLD;
+/*free blocks of at least this size release their pages */
+static size_t trim_threshold = MM_TLSF ? (size_t)-1 : TRIM_THRESHOLD;
+/*placement policy of find_fit, one of the MM_*_FIT values of mm_ext.h */
+static int placement = MM_FIRST_FIT;
+/*largest block kept in the fast bins, 0 while coalescing is immediate */
+static size_t fast_max = 0;
+/*cap of the arena growth step, and whether new heap pages are faulted in at once */
+static size_t grow_max = GROW_MAX;
+static int prefault = MM_TLSF;
+/*whether the heap is laid out in transparent huge pages, see HEAP_ALIGN */
+static int hugepages = 0;
+/*incremental checker: the segment it is in (NULL between passes), and the settings of mm_check_every */
+#define CHECK_SLICE 64 /*blocks a step of MM_CHECK_EVERY checks*/
+static char *check_seg;
+static unsigned long check_every;
+static size_t check_blocks;
+static mm_check_fn check_report;
+static void *check_arg;
+#if MM_THREADS
+static __thread unsigned long check_ops;
+static pthread_mutex_t check_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static unsigned long check_ops;
+#endif
+#if MM_PERSIST
+/*
+ * A file heap (mm_heap_file): the file holds a header page, the page map and then the heap,
+ * all mapped MAP_SHARED at once over MM_MAX_HEAP bytes of heap, past the end of the file until
+ * the heap grows into them.  Headers hold sizes and every link is a heap offset, so only the
+ * arena state needs converting, which mm_snapshot writes to the header as offsets too.
+ * sealed is set once a snapshot is on disk and cleared, before anything changes, by the next
+ * operation that takes an arena lock: mm_init only reattaches a sealed file.
+ */
+#define PERSIST_MAGIC "mmheap1"
+#define PERSIST_HDR PAGE_ALIGN(sizeof(persist_hdr_t))
+#define PERSIST_MAP PAGE_ALIGN(MM_MAX_HEAP >> PAGE_SHIFT)
+#define PERSIST_BYTES (PERSIST_HDR + PERSIST_MAP + MM_MAX_HEAP)
+
+/*the state of an arena that lives outside its blocks, as heap offsets (0 for NULL)*/
+typedef struct persist_arena {
+    uint64_t heap_listp, epilogue, tree;
+    uint64_t free_lists[NUM_CLASSES];
+    uint64_t slabs[SLAB_CLASSES];
+    uint64_t grow;
+    uint32_t fl_map;
+    uint32_t sl_map[FL_COUNT];
+} persist_arena_t;
+
+typedef struct persist_hdr {
+    char magic[8];                  /*PERSIST_MAGIC, NUL-terminated*/
+    uint32_t wsize, narenas, classes, tlsf; /*the build that wrote the file: all must match*/
+    uint64_t max_heap;
+    uint64_t sealed;                /*1 while the file holds the last snapshot unchanged*/
+    uint64_t base;                  /*address the file was mapped at, tried first on a reattach*/
+    uint64_t brk;                   /*heap bytes*/
+    uint64_t root;                  /*heap offset of the block of mm_set_root, 0 for none*/
+    persist_arena_t arenas[MM_NARENAS];
+} persist_hdr_t;
+
+static char persist_path[4096];     /*file of the next mm_init, empty for an sbrk heap*/
+static int persist_fd = -1;
+static char *persist_map;
+static persist_hdr_t *persist_hdr;
+static int persist_sealed;
+static size_t persist_threshold;    /*mmap_threshold and guard_rate of the sbrk heap, back in force after persist_close*/
+#if MM_GUARD
+static unsigned long persist_guard;
+#endif
+#define PERSIST_DIRTY() do { if (__atomic_load_n(&persist_sealed, __ATOMIC_ACQUIRE)) persist_unseal(); } while (0)
+#else
+#define PERSIST_DIRTY() do { } while (0)
+#endif
+/*heap offset of the block of mm_set_root*/
+static word_t persist_root;
+/*
+ * Handles: entry i of the table holds the block of handle i + 1, NULL while free, and how many
+ * pins keep it in place.  A handle block is an ordinary heap block whose first word holds its
+ * index, so the compactor recognises one by the table pointing back at it.  The table lives in
+ * a mapping of its own and handle_lock covers it; free entries are linked through next.
+ */
+#define HANDLE_HDR ALIGNMENT /*the index word, padded so the payload stays aligned*/
+#define HANDLE_CHUNK 4096 /*entries of the first table, which doubles when full*/
+
+typedef struct handle {
+    char *bp;
+    unsigned int pins;
+    size_t next;                    /*free entry: the next free handle, 0 for none*/
+} handle_t;
+
+static handle_t *handles;
+static size_t handle_count, handle_cap, handle_free;
+#if MM_THREADS
+static pthread_mutex_t handle_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#if MM_GUARD
+/*
+ * Guarded allocations: slot i is the page at GUARD_SLOT(i), between guard pages that are never
+ * accessible; guard_size holds the size of its block, 0 while it is free, and guard_fifo the free
+ * slots from guard_head, the longest free first.  guard_lock covers both.
+ */
+#define GUARD_MAX PAGE_SIZE /*largest request sampled (bytes)*/
+#define GUARD_BYTES ((2*(size_t)MM_GUARD_SLOTS + 1) * PAGE_SIZE)
+#define GUARD_SLOT(i) (guard_base + (2*(size_t)(i) + 1) * PAGE_SIZE)
+#define GUARD_CANARY 0xca
+#define GUARD_POISON 0xdf
+#define IN_GUARD(p) (guard_base != NULL && (char *)(p) >= guard_base && (char *)(p) < guard_base + GUARD_BYTES)
+static char *guard_base;
+static size_t guard_size[MM_GUARD_SLOTS];
+static unsigned int guard_fifo[MM_GUARD_SLOTS];
+static unsigned int guard_head, guard_nfree;
+static unsigned long guard_rate;
+#if MM_THREADS
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned long guard_left;
+#else
+static unsigned long guard_left;
+#endif
+#endif
+#if MM_GUARD || MM_PROF
+#if MM_THREADS
+static __thread unsigned long sample_seed;
+#else
+static unsigned long sample_seed;
+#endif
+#endif
+#if MM_PROF
+/*
+ * Heap profile: every sampled block has a record in prof_recs, hashed by its page so that a
+ * flagged page (PAGE_PROF) leads mm_free to all the samples starting in it, and every distinct
+ * allocation stack a bucket in prof_stacks with its live and total counts.  Both tables live
+ * in mappings of their own, never in the heap they describe, under prof_lock.
+ */
+#define PROF_RATE (512*1024) /*mean bytes allocated between samples*/
+#define PROF_DEPTH 32 /*frames kept per stack*/
+#define PROF_SKIP 2 /*frames of prof_sample and the mm_ function calling it*/
+#define PROF_STACK_BUCKETS 4096
+#define PROF_REC_BUCKETS 16384
+#define PROF_CHUNK (1024*1024) /*bytes mapped at a time for the tables*/
+#define PROF_PAGE(p) ((uintptr_t)(p) >> PAGE_SHIFT)
+#define PROF_REC_BUCKET(p) (PROF_PAGE(p) % PROF_REC_BUCKETS)
+
+typedef struct prof_stack {
+    struct prof_stack *next;
+    unsigned long live_n, alloc_n;  /*samples live and ever taken*/
+    size_t live_b, alloc_b;         /*and their bytes*/
+    int depth;
+    void *pc[PROF_DEPTH];
+} prof_stack_t;
+
+typedef struct prof_rec {
+    struct prof_rec *next;
+    void *ptr;
+    size_t size;
+    prof_stack_t *stack;
+} prof_rec_t;
+
+static unsigned long prof_rate = MM_TLSF ? 0 : PROF_RATE;
+static unsigned long prof_live; /*samples live: frees look for one only while there are any*/
+static unsigned long prof_epoch = 1; /*bumped when the rate or the heap changes, so each thread draws a fresh interval*/
+static prof_stack_t *prof_stacks[PROF_STACK_BUCKETS];
+static prof_rec_t *prof_recs[PROF_REC_BUCKETS];
+static prof_rec_t *prof_spare;
+static char *prof_chunks, *prof_bump, *prof_end;
+#if MM_THREADS
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread long prof_left;
+static __thread unsigned long prof_seen;
+#else
+static long prof_left;
+static unsigned long prof_seen;
+#endif
+/*the fast path of a malloc counts its bytes down, and of a free reads the page map byte IS_SLAB reads too*/
+#define PROF_MALLOC(bp, size) do { if ((bp) != NULL && (prof_left -= (long)(size)) < 0 && prof_rate != 0) prof_sample(bp, size); } while (0)
+#define PROF_FREE(ptr) do { if (__atomic_load_n(&prof_live, __ATOMIC_RELAXED) != 0 && (!IN_HEAP(ptr) || (PAGE_GET(ptr) & PAGE_PROF))) prof_free(ptr); } while (0)
+#else
+#define PROF_MALLOC(bp, size) do { } while (0)
+#define PROF_FREE(ptr) do { } while (0)
+#endif
+#define CHECK_TICK() do { if (__atomic_load_n(&check_every, __ATOMIC_RELAXED) != 0 && ++check_ops >= check_every) check_tick(); } while (0)
+#if MM_STATS
+/*the counters of mm_get_stats*/
+static struct mm_stats stats;
+#endif
+
+#if MM_TRACE
+/*
+ * Trace recording: each thread appends records to its own ring, a single-producer queue that
+ * needs no lock; the flusher thread, or a producer finding its ring full, writes rings out
+ * under trace_lock.  Rings are mapped directly so that tracing never calls into the heap.
+ */
+#define TRACE_RING 16384 /*records per ring, a power of two*/
+#define TRACE_FLUSH_NS 10000000L /*the flusher writes the rings out every 10 ms*/
+
+typedef struct trace_ring {
+    struct trace_ring *next;
+    uint64_t head;              /*records written by the owning thread*/
+    uint64_t tail;              /*records written to the file*/
+    uint32_t tid;
+    int dead;                   /*the owning thread has exited*/
+    struct mm_trace_rec recs[TRACE_RING];
+} trace_ring_t;
+
+static int trace_on;
+static int trace_stopping;
+static int trace_fd = -1;
+static uint64_t trace_t0;
+static unsigned int trace_tids;
+static trace_ring_t *trace_rings;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t trace_flusher;
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static __thread trace_ring_t *trace_ring;
+
+static void trace_rec(int op, size_t size, void *ptr, void *old);
+#define TRACE(op, size, ptr, old) do { if (__atomic_load_n(&trace_on, __ATOMIC_RELAXED)) trace_rec(op, size, ptr, old); } while (0)
+#else
+#define TRACE(op, size, ptr, old) do { } while (0)
+#endif
+
+#if MM_THREADS
+/*
+ * Thread cache: per size class, a LIFO of blocks that are still marked allocated in the heap,
+ * followed by one bin per slab class for objects still counted as used by their run
+ */
+#define TCACHE_MAX 512 /*largest block size kept in a thread cache (bytes)*/
+#define TCACHE_COUNT 16 /*blocks kept per size class*/
+#define TCACHE_BINS (TCACHE_MAX/DSIZE + 1)
+#define TCACHE_SLAB_BIN(cls) (TCACHE_BINS + (cls))
+
+typedef struct tcache {
+    char *bins[TCACHE_BINS + SLAB_CLASSES];
+    unsigned char count[TCACHE_BINS + SLAB_CLASSES];
+    int registered;
+} tcache_t;
+
+static __thread tcache_t tcache;
+static __thread arena_t *thread_arena;
+static pthread_key_t tcache_key;
+static pthread_once_t threads_once = PTHREAD_ONCE_INIT;
+static unsigned int next_arena;
+#if MM_NUMA
+/*nodes arenas are spread over (at most MM_NARENAS), and the next arena of each node a new thread gets*/
+#define NUMA_NODE_FILE "/sys/devices/system/node/online"
+#define ARENA_NODE(a) ((a)->id % numa_nodes)
+static unsigned int numa_nodes = 1;
+static unsigned int numa_next[MM_NARENAS];
+#endif
+
+/*serializes mem_sbrk and segment creation */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Prototypes for helper methods */
+static void *extend_heap(arena_t *a, size_t words);
+static void *grow_heap(arena_t *a, size_t need);
+static void *new_segment(arena_t *a, size_t size);
+static void place(arena_t *a, void *bp, size_t asize);
+static void *find_fit(arena_t *a, size_t asize);
+#if !MM_TLSF
+static void *class_fit(arena_t *a, int k, size_t asize);
+#endif
+static void *coalesce(arena_t *a, void *bp);
+static int size_class(size_t size);
+static int class_above(arena_t *a, int k);
+#if MM_TLSF
+static int class_ceil(size_t size);
+#endif
+static void insert_free_block(arena_t *a, void *bp);
+static void remove_free_block(arena_t *a, void *bp);
+static unsigned int tree_prio(void *bp);
+static char *tree_insert(char *t, char *bp);
+static char *tree_remove(char *t, char *bp);
+static char *tree_fit(arena_t *a, size_t asize);
+#if !MM_TLSF
+static char *tree_aligned_fit(char *t, size_t asize, size_t align);
+#endif
+static long tree_check(arena_t *a, char *t, char *lo, char *hi);
+static int tree_release(arena_t *a, char *t, size_t pad);
+static char *align_in(char *bp, size_t align);
+#if MM_STATS
+static size_t block_bytes(void *ptr);
+#endif
+static void *malloc_block(size_t size);
+static void *memalign_block(size_t align, size_t size);
+static void free_block(void *ptr);
+static void *realloc_block(void *ptr, size_t size);
+static size_t adjust_size(size_t size);
+static arena_t *block_arena(void *bp);
+static void *arena_malloc(arena_t *a, size_t asize);
+static int fast_consolidate(arena_t *a);
+static void arena_free(arena_t *a, void *bp);
+static void *realloc_in_place(arena_t *a, void *oldptr, size_t newsize, size_t want);
+static void copy_block(char *dst, const char *src, size_t n);
+static char *heap_sbrk(arena_t *a, size_t size, size_t *got);
+static void *mmap_alloc(size_t size, size_t align);
+static void mmap_free(void *bp);
+static void *mmap_realloc(void *bp, size_t size);
+static int release_pages(void *bp, size_t keep);
+static int release_span(void *bp, char *from, char *to);
+static void *find_aligned_fit(arena_t *a, size_t asize, size_t align);
+static void *place_aligned(arena_t *a, void *bp, size_t asize, size_t align);
+static int slab_class(size_t size);
+static void *slab_alloc(arena_t *a, int cls);
+static void slab_free(arena_t *a, char *run, void *obj);
+static void free_to_arena(void *ptr);
+static void arena_release(arena_t *a, char *ptr);
+static int check_block(arena_t *a, char *bp, char *end, mm_check_fn report, void *arg);
+static int check_run(arena_t *a, char *bp, mm_check_fn report, void *arg);
+static int check_bins(mm_check_fn report, void *arg);
+static void check_print(void *arg, const void *addr, const char *what);
+static void check_tick(void);
+#if MM_PROF
+static void prof_sample(void *bp, size_t size);
+static void prof_free(void *ptr);
+static void prof_reset(void);
+#endif
+#if MM_GUARD
+static int guard_map(void);
+static int guard_sample(void);
+static void *guard_alloc(size_t size);
+static unsigned int guard_slot(char *bp);
+static void guard_free(char *bp);
+static void *guard_realloc(char *bp, size_t size);
+static void guard_report(char *bp, size_t size, const char *what);
+#endif
+#if MM_PERSIST
+static int persist_valid(const persist_hdr_t *h, off_t size);
+static int persist_open(void);
+static void persist_restore(void);
+static void persist_save(arena_t *a);
+static void persist_unseal(void);
+static void persist_close(void);
+#endif
+static void arena_lock(arena_t *a);
+static size_t handle_new(void);
+static size_t compact_slide(arena_t *a, char *fb);
+#if MM_NUMA
+static void numa_init(void);
+static unsigned int numa_arena(void);
+static void numa_bind(void *p, size_t len, unsigned int node, unsigned int flags);
+#endif
+#if MM_THREADS
+static void remote_push(arena_t *a, char *ptr);
+static void remote_drain(arena_t *a);
+#endif
+
+/*
+ *  * mm_check heap consistency checker, see if the heap and the segregated free lists are correctly linked and implemented
+ *   */
+
+
+int mm_check(void)
+{
+    void *heap_start = heap_base;
+    void *heap_end = heap_brk;
+    char *seg, *bp;
+    unsigned int i, k;
+    unsigned long heap_free = 0, listed_free = 0;
+    int prev_alloc;
+    int err = 0;
+
+    for (i = 0; i < MM_NARENAS; i++)
+        LOCK(&arenas[i].lock);
+
+    for (seg = heap_base; !err && (void *)seg < heap_end; seg = bp)
+    {
+/*check that the segment belongs to a known arena*/
+        if (GET(seg) >= MM_NARENAS || (unsigned long)seg % PAGE_SIZE != 0)
+        {
+           printf("segment with a bad arena id!");
+           err = 1;
+           break;
+        }
+        prev_alloc = 1;
+        for (bp = seg + SEG_OVERHEAD; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        {
+            size_t size = GET_SIZE(HDRP(bp));
+/*check that the blocks are correctly aligned*/
+            if (size % ALIGNMENT != 0 || (unsigned long)bp % ALIGNMENT != 0)
+            {
+               printf("block %p not %d-byte aligned\n", (void *)bp, (int)ALIGNMENT);
+               err = 1;
+               break;
+            }
+/*check that pointers in heap block are valid heap addresses.*/
+            if ((void *)HDRP(bp) < heap_start || (void *)NEXT_BLKP(bp) > heap_end)
+            {
+               printf("Invalid heap addresses");
+               err = 1;
+               break;
+            }
+#if MM_THREADS
+/*check that the block lies in pages owned by the segment's arena (the page of its payload)*/
+            if ((PAGE_GET(bp) & PAGE_ARENA) != GET(seg) + 1)
+            {
+               printf("block in a page of another arena!");
+               err = 1;
+               break;
+            }
+#endif
+/*check that the prev-alloc bit agrees with the previous block*/
+            if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+            {
+               printf("prev-alloc bit is stale!");
+               err = 1;
+               break;
+            }
+            prev_alloc = GET_ALLOC(HDRP(bp));
+            if (!GET_ALLOC(HDRP(bp)))
+            {
+/*check that no free blocks are contiguous*/
+                if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+                {
+                   printf("Two consecutive free blocks!");
+                   err = 1;
+                   break;
+                }
+                if (GET(HDRP(bp)) != GET(FTRP(bp)))
+                {
+                   printf("header and footer do not match!");
+                   err = 1;
+                   break;
+                }
+                heap_free++;
+            }
+        }
+        if (!err && !GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+        {
+           printf("epilogue prev-alloc bit is stale!");
+           err = 1;
+        }
+    }
+
+/*check that every listed block is free, in the right class and correctly back-linked*/
+    for (i = 0; !err && i < MM_NARENAS; i++)
+    {
+        for (k = 0; !err && k < NUM_CLASSES; k++)
+        {
+            for (bp = arenas[i].free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+            {
+                if ((void *)bp < heap_start || (void *)bp > heap_end)
+                {
+                   printf("free list pointer out of the heap!");
+                   err = 1;
+                   break;
+                }
+                if (GET_ALLOC(HDRP(bp)) || size_class(GET_SIZE(HDRP(bp))) != (int)k || block_arena(bp) != &arenas[i])
+                {
+                   printf("block in the wrong free list!");
+                   err = 1;
+                   break;
+                }
+                if (NEXT_FREE(bp) != NULL && PREV_FREE(NEXT_FREE(bp)) != bp)
+                {
+                   printf("free list links broken!");
+                   err = 1;
+                   break;
+                }
+                listed_free++;
+            }
+            if (!err && ((arenas[i].free_lists[k] != NULL) != ((arenas[i].sl_map[k >> SL_SHIFT] >> (k & (SL_COUNT-1))) & 1) ||
+                         (arenas[i].sl_map[k >> SL_SHIFT] != 0) != ((arenas[i].fl_map >> (k >> SL_SHIFT)) & 1)))
+            {
+               printf("non-empty class bitmap out of date!");
+               err = 1;
+            }
+        }
+        if (!err)
+        {
+            long n = tree_check(&arenas[i], arenas[i].tree, NULL, NULL);
+            if (n < 0)
+               err = 1;
+            else
+               listed_free += n;
+        }
+    }
+/*check that every run with free slots is a flagged page of its arena, with a consistent slot list*/
+    for (i = 0; !err && i < MM_NARENAS; i++)
+    {
+        for (k = 0; !err && k < SLAB_CLASSES; k++)
+        {
+            for (bp = arenas[i].slabs[k]; bp != NULL; bp = LINK_TO_PTR(((slab_t *)bp)->next))
+            {
+                slab_t *s = (slab_t *)bp;
+                unsigned int nfree = (SLAB_END - s->bump) / SLAB_SIZE(k);
+                unsigned int off;
+
+                if (!IS_SLAB(bp) || SLAB_RUN(bp) != bp || block_arena(bp) != &arenas[i] || !GET_ALLOC(HDRP(bp)))
+                {
+                   printf("slab list holds a page that is not a run!");
+                   err = 1;
+                   break;
+                }
+                for (off = s->free; off != 0 && nfree <= s->nfree; off = *(unsigned short *)(bp + off))
+                    nfree++;
+                if (s->cls != k || s->nfree == 0 || nfree != s->nfree)
+                {
+                   printf("slab run free count is wrong!");
+                   err = 1;
+                   break;
+                }
+            }
+        }
+    }
+/*check that every fast-bin or remote-free block is an allocated block of its arena*/
+    for (i = 0; !err && i < MM_NARENAS; i++)
+    {
+        unsigned long fast_bytes = 0;
+
+        for (k = 0; !err && k < FAST_BINS; k++)
+        {
+            for (bp = arenas[i].fast[k]; bp != NULL; bp = *(char **)bp)
+            {
+                if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != k * DSIZE || block_arena(bp) != &arenas[i])
+                {
+                   printf("fast bin holds a wrong block!");
+                   err = 1;
+                   break;
+                }
+                fast_bytes += GET_SIZE(HDRP(bp));
+            }
+        }
+        if (!err && fast_bytes != arenas[i].fast_bytes)
+        {
+           printf("fast bin byte count is wrong!");
+           err = 1;
+        }
+#if MM_THREADS
+        for (bp = __atomic_load_n(&arenas[i].remote, __ATOMIC_ACQUIRE); !err && bp != NULL; bp = *(char **)bp)
+        {
+            if (IS_SLAB(bp) ? block_arena(SLAB_RUN(bp)) != &arenas[i] : (!GET_ALLOC(HDRP(bp)) || block_arena(bp) != &arenas[i]))
+            {
+               printf("remote-free list holds a wrong block!");
+               err = 1;
+            }
+        }
+#endif
+    }
+/*check that every free block in the heap is in some free list*/
+    if (!err && heap_free != listed_free)
+    {
+       printf("free blocks missing from the free lists!");
+       err = 1;
+    }
+
+    for (i = MM_NARENAS; i-- > 0; )
+        UNLOCK(&arenas[i].lock);
+    return err;
+}
+
+/*
+ * mm_check_step - the incremental checker: check the next blocks blocks of the heap, with only
+ * the lock of the arena owning them held, and tell report of every violation; return how many
+ * were found.  The cursor stays a block start between steps because every merge moves it (see
+ * CHECK_MERGED).  A free block must be linked from its own list or treap, and a slab run be on
+ * its class list exactly while it has free slots; the end of a pass checks the fast bins and the
+ * remote-free lists.  A broken block chain ends the pass, since nothing after it can be found.
+ */
+int mm_check_step(size_t blocks, mm_check_fn report, void *arg)
+{
+    arena_t *a;
+    char *bp, *end;
+    int bad = 0, err;
+
+    if (heap_base == NULL || arenas[0].heap_listp == NULL)
+	return 0;
+    if (report == NULL)
+	report = check_print;
+    LOCK(&check_lock);
+    while (blocks > 0)
+    {
+	if (check_seg == NULL)
+	    check_seg = heap_base;
+	if (GET(check_seg) >= MM_NARENAS)
+	{
+	    report(arg, check_seg, "segment with a bad arena id");
+	    check_seg = NULL;
+	    bad++;
+	    break;
+	}
+	a = &arenas[GET(check_seg)];
+	LOCK(&a->lock);
+	LOCK(&heap_lock);
+	end = heap_brk;
+	UNLOCK(&heap_lock);
+	if ((bp = a->check_at) == NULL)
+	{
+	    bp = check_seg + SEG_OVERHEAD;
+	    if (!GET_PREV_ALLOC(HDRP(bp)))
+	    {
+		report(arg, bp, "first block of a segment has a free predecessor");
+		bad++;
+	    }
+	}
+	for (err = 0; blocks > 0 && GET_SIZE(HDRP(bp)) > 0; blocks--, bp = NEXT_BLKP(bp))
+	    if ((err = check_block(a, bp, end, report, arg)) < 0)
+		break;
+	    else
+		bad += err;
+/*a broken chain or the end of the last segment ends the pass; the cursor never waits at an epilogue*/
+	if (err < 0 || (GET_SIZE(HDRP(bp)) == 0 && bp >= end))
+	{
+	    a->check_at = NULL;
+	    UNLOCK(&a->lock);
+	    check_seg = NULL;
+	    bad += err < 0 ? 1 : check_bins(report, arg);
+	    break;
+	}
+	if (GET_SIZE(HDRP(bp)) > 0)
+	{
+	    a->check_at = bp;
+	    UNLOCK(&a->lock);
+	    break;
+	}
+	a->check_at = NULL;
+	check_seg = bp;
+	UNLOCK(&a->lock);
+    }
+    UNLOCK(&check_lock);
+    return bad;
+}
+
+/*
+ * check_block - check block bp of arena a, which lies below end, and its links; return the
+ * number of violations, or -1 if its size cannot be trusted to find the next block
+ */
+static int check_block(arena_t *a, char *bp, char *end, mm_check_fn report, void *arg)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next, *t;
+    int bad = 0, k;
+
+    if (size % ALIGNMENT != 0 || (uintptr_t)bp % ALIGNMENT != 0 || size < DSIZE || size > (size_t)(end - bp))
+    {
+	report(arg, bp, "block with a bad size or alignment");
+	return -1;
+    }
+    next = NEXT_BLKP(bp);
+#if MM_THREADS
+    if ((PAGE_GET(bp) & PAGE_ARENA) != a->id + 1)
+    {
+	report(arg, bp, "block in a page of another arena");
+	bad++;
+    }
+#endif
+    if (!GET_PREV_ALLOC(HDRP(next)) != !GET_ALLOC(HDRP(bp)))
+    {
+	report(arg, next, "prev-alloc bit is stale");
+	bad++;
+    }
+    if (GET_ALLOC(HDRP(bp)))
+    {
+	if (IS_SLAB(bp) && SLAB_RUN(bp) == bp)
+	    bad += check_run(a, bp, report, arg);
+	return bad;
+    }
+    if (!GET_ALLOC(HDRP(next)))
+    {
+	report(arg, bp, "two consecutive free blocks");
+	bad++;
+    }
+    if (GET(HDRP(bp)) != GET(FTRP(bp)))
+    {
+	report(arg, bp, "header and footer do not match");
+	bad++;
+    }
+/*membership is checked from the block itself, so no list or treap is walked whole*/
+    if ((k = size_class(size)) == NUM_CLASSES)
+    {
+	for (t = a->tree; t != NULL && t != bp && IN_HEAP(t); t = TREE_LESS(bp, t) ? TREE_LEFT(t) : TREE_RIGHT(t))
+	    ;
+	if (t != bp)
+	{
+	    report(arg, bp, "free block missing from the treap");
+	    bad++;
+	}
+	return bad;
+    }
+    if ((t = PREV_FREE(bp)) == NULL ? a->free_lists[k] != bp : !IN_HEAP(t) || NEXT_FREE(t) != bp)
+    {
+	report(arg, bp, "free block not linked from its free list");
+	bad++;
+    }
+    if ((t = NEXT_FREE(bp)) != NULL && (!IN_HEAP(t) || PREV_FREE(t) != bp))
+    {
+	report(arg, bp, "free list links broken");
+	bad++;
+    }
+    if (!((a->sl_map[k >> SL_SHIFT] >> (k & (SL_COUNT-1))) & 1))
+    {
+	report(arg, bp, "free block in a class marked empty");
+	bad++;
+    }
+    return bad;
+}
+
+/* check_run - check the free slots of slab run bp of arena a and whether it is on its class list */
+static int check_run(arena_t *a, char *bp, mm_check_fn report, void *arg)
+{
+    slab_t *s = (slab_t *)bp;
+    unsigned int nfree, off;
+    char *t;
+
+    if (s->cls >= SLAB_CLASSES || s->bump < SLAB_HDR || s->bump > SLAB_END)
+    {
+	report(arg, bp, "slab run with a bad header");
+	return 1;
+    }
+    nfree = (SLAB_END - s->bump) / SLAB_SIZE(s->cls);
+    for (off = s->free; off != 0 && off < SLAB_END && nfree <= s->nfree; off = *(unsigned short *)(bp + off))
+	nfree++;
+    if (nfree != s->nfree || off != 0)
+    {
+	report(arg, bp, "slab run free count is wrong");
+	return 1;
+    }
+/*slab_unlink leaves the links of a full run as they were, so only those of a listed run mean anything*/
+    if (s->nfree == 0)
+	t = a->slabs[s->cls] == bp ? bp : NULL;
+    else if (s->prev == 0)
+	t = a->slabs[s->cls] == bp ? NULL : bp;
+    else
+	t = IN_HEAP(LINK_TO_PTR(s->prev)) && ((slab_t *)LINK_TO_PTR(s->prev))->next == PTR_TO_LINK(bp) ? NULL : bp;
+    if (t != NULL)
+    {
+	report(arg, bp, s->nfree != 0 ? "slab run with free slots missing from its list" : "full slab run on its list");
+	return 1;
+    }
+    return 0;
+}
+
+/* check_bins - the end of a pass: check the fast bins, remote-free lists and class bitmaps of every arena */
+static int check_bins(mm_check_fn report, void *arg)
+{
+    arena_t *a;
+    char *bp;
+    size_t fast_bytes;
+    unsigned int i, k;
+    int bad = 0;
+
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+	a = &arenas[i];
+	if (a->heap_listp == NULL)
+	    continue;
+	LOCK(&a->lock);
+	fast_bytes = 0;
+	for (k = 0; k < FAST_BINS; k++)
+	    for (bp = a->fast[k]; bp != NULL; bp = *(char **)bp)
+	    {
+		if (!IN_HEAP(bp) || !GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != k * DSIZE || block_arena(bp) != a)
+		{
+		    report(arg, bp, "fast bin holds a wrong block");
+		    bad++;
+		    break;
+		}
+		fast_bytes += k * DSIZE;
+	    }
+	if (!bad && fast_bytes != a->fast_bytes)
+	{
+	    report(arg, a->fast, "fast bin byte count is wrong");
+	    bad++;
+	}
+#if MM_THREADS
+	for (bp = __atomic_load_n(&a->remote, __ATOMIC_ACQUIRE); bp != NULL; bp = *(char **)bp)
+	    if (!IN_HEAP(bp) || (IS_SLAB(bp) ? block_arena(SLAB_RUN(bp)) != a : (!GET_ALLOC(HDRP(bp)) || block_arena(bp) != a)))
+	    {
+		report(arg, bp, "remote-free list holds a wrong block");
+		bad++;
+		break;
+	    }
+#endif
+	for (k = 0; k < NUM_CLASSES; k++)
+	    if ((a->free_lists[k] != NULL) != ((a->sl_map[k >> SL_SHIFT] >> (k & (SL_COUNT-1))) & 1) ||
+		(a->sl_map[k >> SL_SHIFT] != 0) != ((a->fl_map >> (k >> SL_SHIFT)) & 1))
+	    {
+		report(arg, &a->free_lists[k], "non-empty class bitmap out of date");
+		bad++;
+	    }
+	for (k = 0; k < SLAB_CLASSES; k++)
+	    if (a->slabs[k] != NULL && (!IS_SLAB(a->slabs[k]) || ((slab_t *)a->slabs[k])->cls != k || ((slab_t *)a->slabs[k])->prev != 0))
+	    {
+		report(arg, a->slabs[k], "slab list head is not a run of its class");
+		bad++;
+	    }
+	UNLOCK(&a->lock);
+    }
+    return bad;
+}
+
+/* check_print - the report of mm_check_step when none is given */
+static void check_print(void *arg, const void *addr, const char *what)
+{
+    (void)arg;
+    fprintf(stderr, "mm_check: %s at %p\n", what, addr);
+}
+
+/* mm_check_every - set up the steps CHECK_TICK runs from mm_malloc and mm_free */
+void mm_check_every(unsigned long ops, size_t blocks, mm_check_fn report, void *arg)
+{
+    check_blocks = blocks;
+    check_report = report;
+    check_arg = arg;
+    __atomic_store_n(&check_every, ops, __ATOMIC_RELAXED);
+}
+
+/* check_tick - the step due after check_every operations of the calling thread */
+static void check_tick(void)
+{
+    check_ops = 0;
+    mm_check_step(check_blocks, check_report, check_arg);
+}
+
+/* size_class - map a block size to its segregated free list, NUM_CLASSES for the treap */
+static int size_class(size_t size)
+{
+    int log;
+
+    if (size >= TREE_MIN)
+        return NUM_CLASSES;
+    log = 31 - __builtin_clz((unsigned int)size);
+    return (log - 4) * SL_COUNT + (int)((size >> (log - SL_SHIFT)) & (SL_COUNT-1));
+}
+
+#if MM_TLSF
+/* class_ceil - the first class all of whose blocks hold size bytes, NUM_CLASSES for the treap */
+static int class_ceil(size_t size)
+{
+    int log;
+
+    if (size >= TREE_MIN)
+        return NUM_CLASSES;
+    log = 31 - __builtin_clz((unsigned int)size);
+    return size_class(size + ((size_t)1 << (log - SL_SHIFT)) - 1);
+}
+#endif
+
+/* class_above - the first non-empty class after class k, NUM_CLASSES if there is none */
+static int class_above(arena_t *a, int k)
+{
+    int f = k >> SL_SHIFT;
+    unsigned int map = a->sl_map[f] & ~((2u << (k & (SL_COUNT-1))) - 1);
+
+    if (map == 0)
+    {
+        if ((map = a->fl_map & ~((2u << f) - 1)) == 0)
+            return NUM_CLASSES;
+        f = __builtin_ctz(map);
+        map = a->sl_map[f];
+    }
+    return f * SL_COUNT + __builtin_ctz(map);
+}
+
+/* insert_free_block - push a free block onto the front of its size class, or into the treap */
+static void insert_free_block(arena_t *a, void *bp)
+{
+    int k = size_class(GET_SIZE(HDRP(bp)));
+
+    if (k == NUM_CLASSES)
+    {
+        a->tree = tree_insert(a->tree, bp);
+        return;
+    }
+    SET_NEXT_FREE(bp, a->free_lists[k]);
+    SET_PREV_FREE(bp, NULL);
+    if (a->free_lists[k] != NULL)
+        SET_PREV_FREE(a->free_lists[k], bp);
+    a->free_lists[k] = bp;
+    a->sl_map[k >> SL_SHIFT] |= 1u << (k & (SL_COUNT-1));
+    a->fl_map |= 1u << (k >> SL_SHIFT);
+}
+
+/* remove_free_block - unlink a free block from its size class or the treap */
+static void remove_free_block(arena_t *a, void *bp)
+{
+    char *next = NEXT_FREE(bp);
+    char *prev = PREV_FREE(bp);
+    int k = size_class(GET_SIZE(HDRP(bp)));
+
+    if (k == NUM_CLASSES)
+    {
+        a->tree = tree_remove(a->tree, bp);
+        return;
+    }
+    if (prev != NULL)
+        SET_NEXT_FREE(prev, next);
+    else if ((a->free_lists[k] = next) == NULL &&
+             (a->sl_map[k >> SL_SHIFT] &= ~(1u << (k & (SL_COUNT-1)))) == 0)
+        a->fl_map &= ~(1u << (k >> SL_SHIFT));
+    if (next != NULL)
+        SET_PREV_FREE(next, prev);
+    if (a->rovers[k] == bp)
+        a->rovers[k] = next;
+}
+
+/* tree_prio - treap priority of block bp, a hash of its address so that no word is spent on it */
+static unsigned int tree_prio(void *bp)
+{
+    uint64_t x = (char *)bp - heap_base;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (unsigned int)x;
+}
+
+/* tree_insert - insert free block bp into the treap rooted at t, return the new root */
+static char *tree_insert(char *t, char *bp)
+{
+    char *c;
+
+    if (t == NULL)
+    {
+        SET_TREE_LEFT(bp, NULL);
+        SET_TREE_RIGHT(bp, NULL);
+        return bp;
+    }
+    if (TREE_LESS(bp, t))
+    {
+        c = tree_insert(TREE_LEFT(t), bp);
+        SET_TREE_LEFT(t, c);
+        if (tree_prio(c) > tree_prio(t))
+        {
+            SET_TREE_LEFT(t, TREE_RIGHT(c)); /*rotate right*/
+            SET_TREE_RIGHT(c, t);
+            return c;
+        }
+    }
+    else
+    {
+        c = tree_insert(TREE_RIGHT(t), bp);
+        SET_TREE_RIGHT(t, c);
+        if (tree_prio(c) > tree_prio(t))
+        {
+            SET_TREE_RIGHT(t, TREE_LEFT(c)); /*rotate left*/
+            SET_TREE_LEFT(c, t);
+            return c;
+        }
+    }
+    return t;
+}
+
+/* tree_merge - join treaps l and r, every key of l being below every key of r */
+static char *tree_merge(char *l, char *r)
+{
+    char *c;
+
+    if (l == NULL)
+        return r;
+    if (r == NULL)
+        return l;
+    if (tree_prio(l) > tree_prio(r))
+    {
+        c = tree_merge(TREE_RIGHT(l), r);
+        SET_TREE_RIGHT(l, c);
+        return l;
+    }
+    c = tree_merge(l, TREE_LEFT(r));
+    SET_TREE_LEFT(r, c);
+    return r;
+}
+
+/* tree_remove - remove block bp, whose header still holds its size, from the treap rooted at t */
+static char *tree_remove(char *t, char *bp)
+{
+    char *c;
+
+    if (t == bp)
+        return tree_merge(TREE_LEFT(t), TREE_RIGHT(t));
+    if (TREE_LESS(bp, t))
+    {
+        c = tree_remove(TREE_LEFT(t), bp);
+        SET_TREE_LEFT(t, c);
+    }
+    else
+    {
+        c = tree_remove(TREE_RIGHT(t), bp);
+        SET_TREE_RIGHT(t, c);
+    }
+    return t;
+}
+
+/* tree_fit - smallest block of at least asize bytes in the treap of a, the lowest-addressed among equals */
+static char *tree_fit(arena_t *a, size_t asize)
+{
+    char *t = a->tree, *best = NULL;
+
+    while (t != NULL)
+    {
+        STAT_PROBE(a);
+        if (GET_SIZE(HDRP(t)) >= asize)
+        {
+            best = t;
+            t = TREE_LEFT(t);
+        }
+        else
+            t = TREE_RIGHT(t);
+    }
+    return best;
+}
+
+#if !MM_TLSF
+/* tree_aligned_fit - smallest block of the treap that can hold an asize block aligned as find_aligned_fit requires */
+static char *tree_aligned_fit(char *t, size_t asize, size_t align)
+{
+    char *bp;
+
+    if (t == NULL)
+        return NULL;
+    if (GET_SIZE(HDRP(t)) < asize)
+        return tree_aligned_fit(TREE_RIGHT(t), asize, align);
+    if ((bp = tree_aligned_fit(TREE_LEFT(t), asize, align)) != NULL)
+        return bp;
+    if (align_in(t, align) + asize <= t + GET_SIZE(HDRP(t)))
+        return t;
+    return tree_aligned_fit(TREE_RIGHT(t), asize, align);
+}
+#endif
+
+/*
+ * tree_check - check the treap rooted at t of arena a, all of whose keys lie between lo and hi
+ * (NULL for no bound); return the number of blocks in it, or -1 after printing an error
+ */
+static long tree_check(arena_t *a, char *t, char *lo, char *hi)
+{
+    long l, r;
+
+    if (t == NULL)
+        return 0;
+    if (t < heap_base || t > heap_brk)
+    {
+       printf("treap pointer out of the heap!");
+       return -1;
+    }
+    if (GET_ALLOC(HDRP(t)) || GET_SIZE(HDRP(t)) < TREE_MIN || block_arena(t) != a)
+    {
+       printf("block in the wrong treap!");
+       return -1;
+    }
+    if ((lo != NULL && !TREE_LESS(lo, t)) || (hi != NULL && !TREE_LESS(t, hi)))
+    {
+       printf("treap out of order!");
+       return -1;
+    }
+    if ((TREE_LEFT(t) != NULL && tree_prio(TREE_LEFT(t)) > tree_prio(t)) || (TREE_RIGHT(t) != NULL && tree_prio(TREE_RIGHT(t)) > tree_prio(t)))
+    {
+       printf("treap priorities out of order!");
+       return -1;
+    }
+    if ((l = tree_check(a, TREE_LEFT(t), lo, t)) < 0 || (r = tree_check(a, TREE_RIGHT(t), t, hi)) < 0)
+        return -1;
+    return l + r + 1;
+}
+
+/* mm_coalesce - coalesce freed blocks, bp must already have its free header and footer */
+static void *coalesce(arena_t *a, void *bp)
+{
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (prev_alloc && next_alloc)
+        {/*nothing to merge*/}
+
+    else if (prev_alloc && !next_alloc)
+    {
+        CHECK_MERGED(a, NEXT_BLKP(bp), bp);
+        remove_free_block(a, NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+    }
+
+    else if (!prev_alloc && next_alloc)
+    {
+        CHECK_MERGED(a, bp, PREV_BLKP(bp));
+        remove_free_block(a, PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        bp = PREV_BLKP(bp);
+    }
+
+    else
+    {
+        CHECK_MERGED(a, bp, PREV_BLKP(bp));
+        CHECK_MERGED(a, NEXT_BLKP(bp), PREV_BLKP(bp));
+        remove_free_block(a, PREV_BLKP(bp));
+        remove_free_block(a, NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, PREV_ALLOC));
+        bp = PREV_BLKP(bp);
+    }
+/*a free block never follows another one, so the merged block is always preceded by an allocated block*/
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    insert_free_block(a, bp);
+    return bp;
+}
+
+/* prefault_pages - fault in the len bytes of fresh heap at p, so the first requests there take no page faults */
+static void prefault_pages(char *p, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, len, MADV_POPULATE_WRITE) == 0)
+	return;
+#endif
+/*nothing lives there yet, so touching each page is harmless*/
+    for (; len >= PAGE_SIZE; p += PAGE_SIZE, len -= PAGE_SIZE)
+	*(volatile char *)p = 0;
+}
+
+/*
+ * heap_sbrk - grow the break by size bytes (whole pages) for arena a in steps mem_sbrk can take;
+ * if a later step fails, *got tells how much was obtained.  The caller holds the heap lock.
+ */
+static char *heap_sbrk(arena_t *a, size_t size, size_t *got)
+{
+    char *start = NULL, *p;
+    size_t step;
+
+    *got = 0;
+/*the page map does not describe anything past MM_MAX_HEAP*/
+    if (size > MM_MAX_HEAP - (size_t)(heap_brk - heap_base))
+	return NULL;
+#if MM_PERSIST
+/*a file heap is mapped whole already: the file grows under it, with its blocks reserved so that a full disk fails here and not on a later store*/
+    if (persist_fd >= 0)
+    {
+	if (posix_fallocate(persist_fd, PERSIST_HDR + PERSIST_MAP + (heap_brk - heap_base), size) != 0)
+	    return NULL;
+	start = heap_brk;
+	*got = size;
+    }
+#endif
+    while (*got < size)
+    {
+	step = MIN(size - *got, SBRK_STEP);
+	if ((p = mem_sbrk((int)step)) == (void *)-1)
+	    break;
+	if (start == NULL)
+	    start = p;
+	*got += step;
+    }
+    __atomic_store_n(&heap_brk, heap_brk + *got, __ATOMIC_RELAXED);
+#if MM_NUMA
+/*nothing has touched the new pages yet, so they all come from the arena's node*/
+    if (*got > 0)
+	numa_bind(start, *got, ARENA_NODE(a), 0);
+#else
+    (void)a;
+#endif
+#ifdef MADV_HUGEPAGE
+    if (hugepages && *got > 0)
+	madvise(start, *got, MADV_HUGEPAGE);
+#endif
+    if (prefault && *got > 0)
+	prefault_pages(start, *got);
+    return start;
+}
+
+/*
+ * new_segment - start a segment of size bytes (whole pages) for arena a at the break,
+ * the caller holds the heap lock; return its single free block, or NULL if the heap
+ * could not grow by the whole size (whatever was obtained still becomes a segment)
+ */
+static void *new_segment(arena_t *a, size_t size)
+{
+    char *seg, *bp;
+    size_t got;
+
+    if ((seg = heap_sbrk(a, size, &got)) == NULL)
+	return NULL;
+    memset(&PAGE_MAP(seg), a->id + 1, got >> PAGE_SHIFT);
+    PUT(seg, a->id);  /*First word unused for alignment, records the owning arena*/
+    PUT(seg + (1*WSIZE), PACK(DSIZE, 1)); /*Prologue header*/
+    PUT(seg + (2*WSIZE), PACK(DSIZE, 1)); /*Prologue footer*/
+    bp = seg + SEG_OVERHEAD;
+    PUT(HDRP(bp), PACK(got - SEG_OVERHEAD, PREV_ALLOC)); /*free block header*/
+    PUT(FTRP(bp), GET(HDRP(bp))); /*free block footer*/
+    a->epilogue = HDRP(NEXT_BLKP(bp));
+    PUT(a->epilogue, PACK(0, 1)); /*Epilogue header*/
+    if (a->heap_listp == NULL)
+	a->heap_listp = seg + (2*WSIZE);
+    insert_free_block(a, bp);
+    return got == size ? bp : NULL;
+}
+
+/*
+ * extend_heap - extends the arena's last segment, or starts a new one if another arena took the break;
+ * NULL if the heap cannot grow by the whole amount (any part obtained is kept as a free block)
+ */
+static void *extend_heap (arena_t *a, size_t words)
+{
+    char *bp;
+    size_t size, got;
+    
+#if MM_TLSF
+/*the pool reserved by arena_init is all there is, mem_sbrk never runs on the allocation path*/
+    if (a->heap_listp != NULL)
+	return NULL;
+#endif
+    /* allocate whole pages, which also maintains alignment */
+    size = HEAP_ALIGN(words * WSIZE);
+    STAT_ADD(extend_calls, 1);
+    LOCK(&heap_lock);
+    if (heap_brk != a->epilogue + WSIZE)
+    {
+	bp = new_segment(a, HEAP_ALIGN(words * WSIZE + SEG_OVERHEAD));
+	UNLOCK(&heap_lock);
+	return bp;
+    }
+    if ((bp = heap_sbrk(a, size, &got)) == NULL)
+    {
+	UNLOCK(&heap_lock);
+	return NULL;
+    }
+    memset(&PAGE_MAP(bp), a->id + 1, got >> PAGE_SHIFT);
+    UNLOCK(&heap_lock);
+    /*Initialize free block header/footer and the epilogue header, the old epilogue knows whether its predecessor is allocated */
+    PUT(HDRP(bp), PACK(got, GET_PREV_ALLOC(HDRP(bp)))); /*free block header*/
+    PUT(FTRP(bp), GET(HDRP(bp))); /*free block footer*/
+    a->epilogue = HDRP(NEXT_BLKP(bp));
+    PUT(a->epilogue, PACK(0,1)); /*epilogue header*/
+
+    /* Coalesce if the previous block was free*/
+    bp = coalesce(a, bp);
+    return got == size ? bp : NULL;
+}
+
+/*
+ * grow_heap - extend arena a for a request that needs a free block of need bytes, by its growth
+ * step if that is more, and double the step up to grow_max; return the free block, NULL if out of memory
+ */
+static void *grow_heap(arena_t *a, size_t need)
+{
+    size_t size = MAX(need, a->grow);
+    void *bp;
+
+    if ((bp = extend_heap(a, size/WSIZE)) != NULL)
+    {
+	a->grow = MIN(2*a->grow, grow_max);
+	return bp;
+    }
+/*the headroom is optional, and the part of it the heap could give may already be enough*/
+    if (size == need || ((bp = find_fit(a, need)) == NULL && (bp = extend_heap(a, need/WSIZE)) == NULL))
+	return NULL;
+    return bp;
+}
+
+/* arena_init - give arena a its first segment */
+static int arena_init(arena_t *a)
+{
+    void *bp;
+
+    LOCK(&heap_lock);
+    bp = new_segment(a, HEAP_ALIGN(MM_TLSF ? MM_TLSF_POOL : CHUNKSIZE));
+    UNLOCK(&heap_lock);
+    return bp == NULL ? -1 : 0;
+}
+
+#if MM_THREADS
+/* tcache_flush - return every block cached by the calling thread to its arena */
+static void tcache_flush(tcache_t *tc)
+{
+    int i;
+    char *bp;
+
+    for (i = 0; i < TCACHE_BINS + SLAB_CLASSES; i++)
+    {
+        while ((bp = tc->bins[i]) != NULL)
+        {
+            tc->bins[i] = *(char **)bp;
+            free_to_arena(bp);
+        }
+        tc->count[i] = 0;
+    }
+}
+
+/* tcache_exit - thread-exit destructor registered for every thread that cached a block */
+static void tcache_exit(void *tc)
+{
+    tcache_flush(tc);
+}
+
+/* threads_init - one-time setup of the thread-cache key and the arena locks */
+static void threads_init(void)
+{
+    int i;
+
+    pthread_key_create(&tcache_key, tcache_exit);
+    for (i = 0; i < MM_NARENAS; i++)
+        pthread_mutex_init(&arenas[i].lock, NULL);
+}
+
+/* tcache_get - pop a cached block from bin i, NULL if the bin is empty */
+static void *tcache_get(size_t i)
+{
+    char *bp = tcache.bins[i];
+
+    if (bp != NULL)
+    {
+        tcache.bins[i] = *(char **)bp;
+        tcache.count[i]--;
+        STAT_ADD(tcache_hits, 1);
+    }
+    return bp;
+}
+
+/* tcache_put - keep an allocated block in bin i of the calling thread's cache, return 0 if the bin is full */
+static int tcache_put(void *bp, size_t i)
+{
+    if (tcache.count[i] >= TCACHE_COUNT)
+        return 0;
+    if (!tcache.registered)
+    {
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = 1;
+    }
+    *(char **)bp = tcache.bins[i];
+    tcache.bins[i] = bp;
+    tcache.count[i]++;
+    return 1;
+}
+
+/* thread_arena_get - the arena of the calling thread, assigned round-robin on first use */
+static arena_t *thread_arena_get(void)
+{
+    arena_t *a;
+
+    if (thread_arena == NULL)
+    {
+#if MM_NUMA
+        a = &arenas[numa_arena()];
+#else
+        a = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % MM_NARENAS];
+#endif
+        LOCK(&a->lock);
+        PERSIST_DIRTY();
+        if (a->heap_listp == NULL && arena_init(a) == -1)
+        {
+            UNLOCK(&a->lock);
+            return NULL;
+        }
+        UNLOCK(&a->lock);
+        thread_arena = a;
+    }
+    return thread_arena;
+}
+
+#if MM_NUMA
+/* numa_init - count the nodes from the highest one online, 1 if the system does not tell */
+static void numa_init(void)
+{
+    char buf[256], *p;
+    unsigned long node, top = 0;
+    FILE *f;
+    size_t n;
+
+    memset(numa_next, 0, sizeof(numa_next));
+    numa_nodes = 1;
+    if ((f = fopen(NUMA_NODE_FILE, "r")) == NULL)
+	return;
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+/*a list of ranges such as 0-1,3: the arenas of a node that is not online are simply never picked*/
+    for (p = buf; *p != '\0'; )
+	if (*p >= '0' && *p <= '9')
+	{
+	    node = strtoul(p, &p, 10);
+	    top = MAX(top, node);
+	}
+	else
+	    p++;
+    numa_nodes = (unsigned int)MIN(top + 1, MM_NARENAS);
+}
+
+/* numa_arena - the next arena, round-robin, of the node the calling thread runs on */
+static unsigned int numa_arena(void)
+{
+    unsigned int cpu, node = 0, per;
+
+    if (numa_nodes > 1 && syscall(SYS_getcpu, &cpu, &node, NULL) == -1)
+	node = 0;
+    node %= numa_nodes;
+    per = (MM_NARENAS - node + numa_nodes - 1) / numa_nodes;
+    return node + numa_nodes * (__atomic_fetch_add(&numa_next[node], 1, __ATOMIC_RELAXED) % per);
+}
+
+/* numa_bind - prefer node for the len bytes of pages at p, moving any already there with MPOL_MF_MOVE in flags */
+static void numa_bind(void *p, size_t len, unsigned int node, unsigned int flags)
+{
+    unsigned long mask = 1UL << node;
+
+/*preferred, not bound: a full node spills to another instead of failing the request*/
+    if (numa_nodes > 1)
+	syscall(SYS_mbind, p, len, MPOL_PREFERRED, &mask, 8 * sizeof(mask), flags);
+}
+#endif
+#endif
+
+/* block_arena - the arena owning block bp */
+static arena_t *block_arena(void *bp)
+{
+#if MM_THREADS
+    return &arenas[(PAGE_GET(bp) & PAGE_ARENA) - 1];
+#else
+    (void)bp;
+    return &arenas[0];
+#endif
+}
+
+#if MM_PERSIST
+/* persist_valid - whether header h, read from a file of size bytes, is a sealed heap of this build */
+static int persist_valid(const persist_hdr_t *h, off_t size)
+{
+    return memcmp(h->magic, PERSIST_MAGIC, sizeof(h->magic)) == 0 && h->wsize == WSIZE &&
+	h->narenas == MM_NARENAS && h->classes == NUM_CLASSES && h->tlsf == MM_TLSF &&
+	h->max_heap == MM_MAX_HEAP && h->sealed == 1 && h->brk % PAGE_SIZE == 0 &&
+	h->brk <= MM_MAX_HEAP && (uint64_t)size >= PERSIST_HDR + PERSIST_MAP + h->brk;
+}
+
+/*
+ * persist_open - map the heap from persist_path, at the address it had if that is free; return
+ * 1 for a sealed heap to reattach, 0 for a new empty file and -1 if the file cannot be used
+ */
+static int persist_open(void)
+{
+    persist_hdr_t h;
+    struct stat st;
+    char *map;
+    int fd, fresh;
+
+    if ((fd = open(persist_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1)
+	return -1;
+    if (fstat(fd, &st) == -1 || ((fresh = st.st_size == 0) ? ftruncate(fd, PERSIST_HDR + PERSIST_MAP) == -1 :
+	pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || !persist_valid(&h, st.st_size)))
+    {
+	close(fd);
+	return -1;
+    }
+    if ((map = mmap(fresh ? NULL : (void *)(uintptr_t)h.base, PERSIST_BYTES, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_NORESERVE, fd, 0)) == MAP_FAILED)
+    {
+	close(fd);
+	return -1;
+    }
+/*the page map comes with the file, so the one of an sbrk heap goes*/
+    if (page_map != NULL)
+	munmap(page_map, MM_MAX_HEAP >> PAGE_SHIFT);
+    persist_fd = fd;
+    persist_map = map;
+    persist_hdr = (persist_hdr_t *)map;
+    page_map = (unsigned char *)map + PERSIST_HDR;
+    heap_base = map + PERSIST_HDR + PERSIST_MAP;
+    hugepages = 0;
+    if (fresh)
+    {
+	memcpy(persist_hdr->magic, PERSIST_MAGIC, sizeof(persist_hdr->magic));
+	persist_hdr->wsize = WSIZE;
+	persist_hdr->narenas = MM_NARENAS;
+	persist_hdr->classes = NUM_CLASSES;
+	persist_hdr->tlsf = MM_TLSF;
+	persist_hdr->max_heap = MM_MAX_HEAP;
+	heap_brk = heap_base;
+	persist_root = 0;
+	return 0;
+    }
+    heap_brk = heap_base + persist_hdr->brk;
+    persist_root = (word_t)persist_hdr->root;
+    persist_sealed = 1;
+    return 1;
+}
+
+/* persist_restore - set up the arenas from the state the last snapshot wrote */
+static void persist_restore(void)
+{
+    persist_arena_t *s;
+    arena_t *a;
+    size_t i;
+    int k;
+
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+	a = &arenas[i];
+	s = &persist_hdr->arenas[i];
+	a->heap_listp = LINK_TO_PTR(s->heap_listp);
+	a->epilogue = LINK_TO_PTR(s->epilogue);
+	a->tree = LINK_TO_PTR(s->tree);
+	for (k = 0; k < NUM_CLASSES; k++)
+	    a->free_lists[k] = LINK_TO_PTR(s->free_lists[k]);
+	for (k = 0; k < SLAB_CLASSES; k++)
+	    a->slabs[k] = LINK_TO_PTR(s->slabs[k]);
+	a->fl_map = s->fl_map;
+	for (k = 0; k < FL_COUNT; k++)
+	    a->sl_map[k] = s->sl_map[k];
+	a->grow = s->grow;
+    }
+/*the samples of MM_PROF died with the process that took them; only a flagged page is written*/
+    for (i = 0; i < (size_t)(heap_brk - heap_base) >> PAGE_SHIFT; i++)
+	if (page_map[i] & PAGE_PROF)
+	    page_map[i] &= ~PAGE_PROF;
+}
+
+/* persist_save - write the state of arena a, whose fast bins are empty, to the header */
+static void persist_save(arena_t *a)
+{
+    persist_arena_t *s = &persist_hdr->arenas[a->id];
+    int k;
+
+    s->heap_listp = PTR_TO_LINK(a->heap_listp);
+    s->epilogue = PTR_TO_LINK(a->epilogue);
+    s->tree = PTR_TO_LINK(a->tree);
+    for (k = 0; k < NUM_CLASSES; k++)
+	s->free_lists[k] = PTR_TO_LINK(a->free_lists[k]);
+    for (k = 0; k < SLAB_CLASSES; k++)
+	s->slabs[k] = PTR_TO_LINK(a->slabs[k]);
+    s->fl_map = a->fl_map;
+    for (k = 0; k < FL_COUNT; k++)
+	s->sl_map[k] = a->sl_map[k];
+    s->grow = a->grow;
+}
+
+/* persist_unseal - mark the file changed since its snapshot, on disk before the change is made; the caller holds an arena lock */
+static void persist_unseal(void)
+{
+    LOCK(&heap_lock);
+    if (persist_sealed)
+    {
+	persist_hdr->sealed = 0;
+	msync(persist_hdr, PERSIST_HDR, MS_SYNC);
+	__atomic_store_n(&persist_sealed, 0, __ATOMIC_RELEASE);
+    }
+    UNLOCK(&heap_lock);
+}
+
+/* persist_close - unmap the file heap of an earlier mm_init, if there is one */
+static void persist_close(void)
+{
+    if (persist_fd < 0)
+	return;
+    munmap(persist_map, PERSIST_BYTES);
+    close(persist_fd);
+    persist_fd = -1;
+    persist_map = NULL;
+    persist_hdr = NULL;
+    page_map = NULL;
+    persist_sealed = 0;
+    mmap_threshold = persist_threshold;
+#if MM_GUARD
+    guard_rate = persist_guard;
+#endif
+}
+#endif
+
+/* mm_heap_file - have the next mm_init map the heap from path, or from sbrk for NULL; -1 without MM_PERSIST or for a path too long */
+int mm_heap_file(const char *path)
+{
+#if MM_PERSIST
+    if (path == NULL)
+	persist_path[0] = '\0';
+    else if (strlen(path) >= sizeof(persist_path))
+	return -1;
+    else
+	strcpy(persist_path, path);
+    return 0;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+/*
+ * mm_snapshot - make the file consistent on disk for the next mm_init to reattach: flush the
+ * caller's thread cache, take every arena lock, consolidate the fast bins, write the arena state
+ * and sync the heap, then seal the header and sync it; return 0 on success and -1 otherwise
+ */
+int mm_snapshot(void)
+{
+#if MM_PERSIST
+    unsigned int i;
+    int rc;
+
+    if (persist_fd < 0)
+	return -1;
+#if MM_THREADS
+    tcache_flush(&tcache);
+#endif
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+	arena_lock(&arenas[i]);
+	fast_consolidate(&arenas[i]);
+	persist_save(&arenas[i]);
+    }
+    LOCK(&heap_lock);
+    persist_hdr->brk = heap_brk - heap_base;
+    persist_hdr->root = persist_root;
+    persist_hdr->base = (uintptr_t)persist_map;
+/*the blocks first, then the seal: a crash between the two leaves a file mm_init refuses*/
+    if ((rc = msync(persist_map, PERSIST_HDR + PERSIST_MAP + (heap_brk - heap_base), MS_SYNC)) == 0)
+    {
+	persist_hdr->sealed = 1;
+	if ((rc = msync(persist_hdr, PERSIST_HDR, MS_SYNC)) == 0)
+	    __atomic_store_n(&persist_sealed, 1, __ATOMIC_RELEASE);
+    }
+    UNLOCK(&heap_lock);
+    for (i = 0; i < MM_NARENAS; i++)
+	UNLOCK(&arenas[i].lock);
+    return rc == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+/* mm_set_root - remember block ptr (NULL for none) in the heap file for mm_get_root after a reattach */
+void mm_set_root(void *ptr)
+{
+    persist_root = PTR_TO_LINK(ptr);
+}
+
+/* mm_get_root - the block of the last mm_set_root, as saved by the snapshot mm_init reattached */
+void *mm_get_root(void)
+{
+    return LINK_TO_PTR(persist_root);
+}
+
+/* 
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void)
+{
+    char *brk;
+    size_t pad;
+    unsigned int i;
+    int attached = 0;
+
+#if MM_PERSIST
+    persist_close();
+    if (persist_path[0] == '\0' && getenv("MM_HEAP_FILE") != NULL)
+	mm_heap_file(getenv("MM_HEAP_FILE"));
+    if (persist_path[0] != '\0')
+    {
+	if ((attached = persist_open()) == -1)
+	    return -1;
+    }
+    else
+#endif
+/*the page map is reserved once and only the pages describing the heap get touched*/
+    if (page_map == NULL)
+    {
+        page_map = mmap(NULL, MM_MAX_HEAP >> PAGE_SHIFT, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (page_map == MAP_FAILED)
+        {
+            page_map = NULL;
+            return -1;
+        }
+    }
+#if MM_THREADS
+    pthread_once(&threads_once, threads_init);
+    memset(&tcache, 0, sizeof(tcache));
+    thread_arena = NULL;
+    next_arena = 0;
+#if MM_NUMA
+    numa_init();
+#endif
+#endif
+//initialize an unused block to satisfy the alignment requirement
+    /*CREATE THE INITIAL EMPTY HEAP, starting on a page (or huge page) boundary*/
+#if MM_PERSIST
+    if (persist_fd < 0)
+#endif
+    {
+	brk = (char *)mem_heap_hi() + 1;
+	pad = HEAP_ALIGN((uintptr_t)brk) - (uintptr_t)brk;
+	if (pad && mem_sbrk(pad) == (void *)-1)
+	    return -1;
+	heap_base = brk + pad;
+	heap_brk = heap_base;
+	persist_root = 0;
+    }
+    
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+        arenas[i].heap_listp = NULL;
+        arenas[i].epilogue = NULL;
+        memset(arenas[i].free_lists, 0, sizeof(arenas[i].free_lists));
+        memset(arenas[i].slabs, 0, sizeof(arenas[i].slabs));
+        memset(arenas[i].rovers, 0, sizeof(arenas[i].rovers));
+        arenas[i].fl_map = 0;
+        memset(arenas[i].sl_map, 0, sizeof(arenas[i].sl_map));
+        arenas[i].tree = NULL;
+        memset(arenas[i].fast, 0, sizeof(arenas[i].fast));
+        arenas[i].fast_bytes = 0;
+        arenas[i].grow = CHUNKSIZE;
+        arenas[i].check_at = NULL;
+#if MM_THREADS
+        arenas[i].remote = NULL;
+#endif
+        arenas[i].id = i;
+    }
+#if MM_PERSIST
+    if (attached)
+	persist_restore();
+#endif
+    check_seg = NULL;
+    handle_count = handle_free = 0;
+#if MM_PROF
+    prof_reset();
+#endif
+#if MM_GUARD
+    if (guard_base != NULL)
+	guard_map();
+    if (!MM_TLSF && guard_rate == 0 && getenv("MM_GUARD_RATE") != NULL)
+	guard_rate = strtoul(getenv("MM_GUARD_RATE"), NULL, 10);
+#endif
+#if MM_PERSIST
+/*every block of a file heap is in the file: none gets a mapping or a guarded page of its own*/
+    if (persist_fd >= 0)
+    {
+	persist_threshold = mmap_threshold;
+	mmap_threshold = (size_t)-1;
+#if MM_GUARD
+	persist_guard = guard_rate;
+	guard_rate = 0;
+#endif
+    }
+#endif
+/* Arena 0 starts with a free block of about CHUNKSIZE bytes, the others when a thread is first assigned to them */
+    if (!attached && arena_init(&arenas[0]) == -1)
+	return -1;
+/*canary hosts turn continuous checking on from the environment*/
+    if (check_every == 0 && getenv("MM_CHECK_EVERY") != NULL)
+	mm_check_every(strtoul(getenv("MM_CHECK_EVERY"), NULL, 10), CHECK_SLICE, NULL, NULL);
+#if MM_TRACE
+/*canary hosts turn recording on from the environment, without a code change*/
+    if (!trace_on && getenv("MM_TRACE_FILE") != NULL)
+	mm_trace_start(getenv("MM_TRACE_FILE"));
+#endif
+    return 0;
+}
+
+/*
+ * mm_findfit - Search the class of asize with the placement policy, then the next non-empty
+ * class, where every block fits, then the treap; if nothing could hold asize, return NULL
+ */
+static void *find_fit(arena_t *a, size_t asize)
+{
+   void *bp = NULL;
+   int k = size_class(asize);
+   int above;
+
+#if MM_STATS
+   a->probes = 0;
+#endif
+#if MM_TLSF
+/*good fit: start from the first class whose blocks all hold asize and take a head, no search*/
+   if ((k = class_ceil(asize)) < NUM_CLASSES && a->free_lists[k] == NULL)
+	k = class_above(a, k);
+   if (k < NUM_CLASSES)
+   {
+	STAT_PROBE(a);
+	bp = a->free_lists[k];
+   }
+   (void)above;
+#else
+   if (k < NUM_CLASSES)
+   {
+	if ((bp = class_fit(a, k, asize)) == NULL && (above = class_above(a, k)) < NUM_CLASSES)
+		bp = class_fit(a, above, asize);
+   }
+#endif
+   if (bp == NULL)
+	bp = tree_fit(a, asize);
+#if MM_STATS
+   {
+	/*bucket b of the histogram counts searches of [2^(b-1), 2^b) probes*/
+	unsigned long n = a->probes;
+	int b = 0;
+
+	while (n > 0 && b < MM_FIT_BUCKETS - 1)
+	{
+		n >>= 1;
+		b++;
+	}
+	STAT_ADD(fit_searches, 1);
+	STAT_ADD(fit_probes, a->probes);
+	STAT_ADD(fit_hist[b], 1);
+	if (bp == NULL)
+		STAT_ADD(fit_misses, 1);
+   }
+#endif
+   return bp;
+
+}
+
+#if !MM_TLSF
+/*
+ * class_fit - the block of free list k that the placement policy picks for asize bytes,
+ * NULL if none of them is large enough
+ */
+static void *class_fit(arena_t *a, int k, size_t asize)
+{
+   char *bp, *start, *best = NULL;
+   size_t size, best_size = 0;
+
+   switch (placement)
+   {
+   case MM_NEXT_FIT:
+/*resume after the block the last search of the class took, wrapping around once*/
+	if ((start = a->rovers[k]) == NULL)
+		start = a->free_lists[k];
+	for (bp = start; bp != NULL; )
+	{
+		STAT_PROBE(a);
+		if (asize<=GET_SIZE(HDRP(bp)))
+		{
+			a->rovers[k] = NEXT_FREE(bp);
+			return bp;
+		}
+		if ((bp = NEXT_FREE(bp)) == NULL)
+			bp = a->free_lists[k];
+		if (bp == start)
+			break;
+	}
+	return NULL;
+
+   case MM_BEST_FIT:
+   case MM_ADDR_BEST_FIT:
+/*smallest block that fits; address-ordered best fit breaks ties by the lowest address*/
+	for (bp = a->free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+	{
+		STAT_PROBE(a);
+		size = GET_SIZE(HDRP(bp));
+		if (size < asize)
+			continue;
+		if (best == NULL || size < best_size || (size == best_size && placement == MM_ADDR_BEST_FIT && bp < best))
+		{
+			best = bp;
+			best_size = size;
+		}
+		if (size == asize && placement == MM_BEST_FIT)
+			break;
+	}
+	return best;
+
+   default:
+	for (bp = a->free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+	{
+		STAT_PROBE(a);
+		if (asize<=GET_SIZE(HDRP(bp)))
+			return bp;
+	}
+	return NULL;
+   }
+}
+#endif
+
+/*
+ * place - allocate asize bytes at the start of bp, unlinking it from its free list
+ * if it is still free, and return any remainder large enough to be a block to the free lists
+ */
+static void place (arena_t *a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    if (!GET_ALLOC(HDRP(bp)))
+	remove_free_block(a, bp);
+/*to split the blocks if the size is greater than what is required*/    
+    if ((csize - asize)>=(2*DSIZE))
+    {
+	PUT(HDRP(bp), PACK(asize,1 | prev_alloc));
+	bp = NEXT_BLKP(bp);
+	PUT(HDRP(bp), PACK(csize-asize,PREV_ALLOC));
+	PUT(FTRP(bp), PACK(csize-asize,PREV_ALLOC));
+	CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	insert_free_block(a, bp);
+    }
+
+    else
+    {
+	PUT(HDRP(bp), PACK(csize,1 | prev_alloc));
+	SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+}
+
+/*
+ * find_aligned_fit - first free block that can hold an asize block whose payload is a
+ * multiple of align, leaving either nothing or a whole free block in front
+ */
+static void *find_aligned_fit(arena_t *a, size_t asize, size_t align)
+{
+#if MM_TLSF
+/*any block that large holds an aligned payload, which keeps the search bounded*/
+   return find_fit(a, asize + align + 2*DSIZE);
+#else
+   char *bp;
+   int k;
+
+   for (k = size_class(asize); k < NUM_CLASSES; k = class_above(a, k))
+   {
+	for (bp = a->free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+	{
+		if (align_in(bp, align) + asize <= bp + GET_SIZE(HDRP(bp)))
+			return bp;
+	}
+   }
+   return tree_aligned_fit(a->tree, asize, align);
+#endif
+}
+
+/* align_in - first payload in free block bp that is a multiple of align and leaves room for a block in front */
+static char *align_in(char *bp, size_t align)
+{
+   char *ab = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+
+   if (ab != bp && ab - bp < 2*DSIZE)
+	ab += align;
+   return ab;
+}
+
+/*
+ * place_aligned - allocate an asize block at the first suitably aligned payload inside free
+ * block bp (see find_aligned_fit), returning the leading fragment to the free lists
+ */
+static void *place_aligned(arena_t *a, void *bp, size_t asize, size_t align)
+{
+    char *ab = align_in(bp, align);
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t lead;
+
+    lead = ab - (char *)bp;
+    if (lead > 0)
+    {
+	remove_free_block(a, bp);
+	PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), GET(HDRP(bp)));
+	insert_free_block(a, bp);
+	PUT(HDRP(ab), PACK(csize - lead, 0));
+	PUT(FTRP(ab), GET(HDRP(ab)));
+	insert_free_block(a, ab);
+    }
+    place(a, ab, asize);
+    return ab;
+}
+
+/* slab_class - the slab class serving a request of size bytes (at most SLAB_MAX) */
+static int slab_class(size_t size)
+{
+    int cls = 0;
+
+    while ((size_t)SLAB_SIZE(cls) < size)
+        cls++;
+    return cls;
+}
+
+/* slab_push - put run at the front of the arena's list of runs with free slots */
+static void slab_push(arena_t *a, char *run)
+{
+    slab_t *s = (slab_t *)run;
+
+    s->next = PTR_TO_LINK(a->slabs[s->cls]);
+    s->prev = 0;
+    if (a->slabs[s->cls] != NULL)
+        ((slab_t *)a->slabs[s->cls])->prev = PTR_TO_LINK(run);
+    a->slabs[s->cls] = run;
+}
+
+/* slab_unlink - take run off the arena's list of runs with free slots */
+static void slab_unlink(arena_t *a, char *run)
+{
+    slab_t *s = (slab_t *)run;
+
+    if (s->prev)
+        ((slab_t *)LINK_TO_PTR(s->prev))->next = s->next;
+    else
+        a->slabs[s->cls] = LINK_TO_PTR(s->next);
+    if (s->next)
+        ((slab_t *)LINK_TO_PTR(s->next))->prev = s->prev;
+}
+
+/* slab_new - carve a page-aligned run for class cls out of the arena, NULL if out of memory */
+static char *slab_new(arena_t *a, int cls)
+{
+    char *run;
+    slab_t *s;
+
+    if ((run = find_aligned_fit(a, PAGE_SIZE, PAGE_SIZE)) == NULL &&
+        (!fast_consolidate(a) || (run = find_aligned_fit(a, PAGE_SIZE, PAGE_SIZE)) == NULL) &&
+        (run = grow_heap(a, 2*PAGE_SIZE)) == NULL)
+	return NULL;
+    run = place_aligned(a, run, PAGE_SIZE, PAGE_SIZE);
+    PAGE_SET(run, PAGE_SLAB);
+    s = (slab_t *)run;
+    s->cls = cls;
+    s->nfree = SLAB_CAPACITY(cls);
+    s->free = 0;
+    s->bump = SLAB_HDR;
+    slab_push(a, run);
+    return run;
+}
+
+/* slab_alloc - hand out a slot of class cls, the caller holds the arena lock */
+static void *slab_alloc(arena_t *a, int cls)
+{
+    char *run = a->slabs[cls];
+    slab_t *s;
+    char *obj;
+
+    if (run == NULL && (run = slab_new(a, cls)) == NULL)
+	return NULL;
+    s = (slab_t *)run;
+    if (s->free != 0)
+    {
+	obj = run + s->free;
+	s->free = *(unsigned short *)obj;
+    }
+    else
+    {
+	obj = run + s->bump;
+	s->bump += SLAB_SIZE(cls);
+    }
+/*a full run leaves the list until one of its slots comes back*/
+    if (--s->nfree == 0)
+	slab_unlink(a, run);
+    return obj;
+}
+
+/* slab_free - give slot obj back to its run, releasing the run once it is empty unless it is the class's last one */
+static void slab_free(arena_t *a, char *run, void *obj)
+{
+    slab_t *s = (slab_t *)run;
+
+    if (s->nfree == 0)
+	slab_push(a, run);
+    *(unsigned short *)obj = s->free;
+    s->free = (char *)obj - run;
+    if (++s->nfree == SLAB_CAPACITY(s->cls) && (s->prev != 0 || s->next != 0))
+    {
+	slab_unlink(a, run);
+	PAGE_CLR(run, PAGE_SLAB);
+	arena_free(a, run);
+    }
+}
+
+#if MM_GUARD || MM_PROF
+/* sample_rand - a xorshift generator per thread, which spaces the samples of MM_GUARD and MM_PROF */
+static unsigned long sample_rand(void)
+{
+    if (sample_seed == 0)
+	sample_seed = (uintptr_t)&sample_seed | 1;
+    sample_seed ^= sample_seed << 13;
+    sample_seed ^= sample_seed >> 7;
+    sample_seed ^= sample_seed << 17;
+    return sample_seed;
+}
+#endif
+
+#if MM_GUARD
+/* guard_map - reserve the pool of guarded pages, all inaccessible, with every slot free; -1 if out of memory */
+static int guard_map(void)
+{
+    unsigned int i;
+
+    if (guard_base == NULL)
+    {
+	if ((guard_base = mmap(NULL, GUARD_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED)
+	{
+	    guard_base = NULL;
+	    return -1;
+	}
+    }
+    else
+	mprotect(guard_base, GUARD_BYTES, PROT_NONE);
+    for (i = 0; i < MM_GUARD_SLOTS; i++)
+    {
+	guard_size[i] = 0;
+	guard_fifo[i] = i;
+    }
+    guard_head = 0;
+    guard_nfree = MM_GUARD_SLOTS;
+    return 0;
+}
+
+/* guard_sample - whether the calling thread's next request goes to a guarded page, one in guard_rate on average */
+static int guard_sample(void)
+{
+    if (guard_left == 0)
+	guard_left = 1 + sample_rand() % (2 * guard_rate - 1);
+    return --guard_left == 0;
+}
+
+/* guard_alloc - size bytes (1 to GUARD_MAX) ending against a guard page, NULL if no slot is free */
+static void *guard_alloc(size_t size)
+{
+    unsigned int i;
+    char *slot, *bp;
+
+    LOCK(&guard_lock);
+    if ((guard_base == NULL && guard_map() == -1) || guard_nfree == 0)
+    {
+	UNLOCK(&guard_lock);
+	return NULL;
+    }
+    i = guard_fifo[guard_head];
+    guard_head = (guard_head + 1) % MM_GUARD_SLOTS;
+    guard_nfree--;
+    guard_size[i] = size;
+    UNLOCK(&guard_lock);
+    slot = GUARD_SLOT(i);
+    mprotect(slot, PAGE_SIZE, PROT_READ | PROT_WRITE);
+/*the payload is as aligned as any other, so up to ALIGNMENT-1 canary bytes sit between it and the guard page*/
+    bp = slot + PAGE_SIZE - ALIGN(size);
+    memset(slot, GUARD_CANARY, bp - slot);
+    memset(bp + size, GUARD_CANARY, ALIGN(size) - size);
+    STAT_ADD(guarded, 1);
+    return bp;
+}
+
+/* guard_slot - the slot of live guarded block bp; anything else is reported */
+static unsigned int guard_slot(char *bp)
+{
+    size_t page = (bp - guard_base) >> PAGE_SHIFT;
+    unsigned int i = (unsigned int)(page / 2);
+
+    if (page % 2 == 0 || guard_size[i] == 0)
+	guard_report(bp, 0, "free of a guarded block that is not allocated (double free?)");
+    if (bp != GUARD_SLOT(i) + PAGE_SIZE - ALIGN(guard_size[i]))
+	guard_report(bp, guard_size[i], "free of a pointer into the middle of a guarded block");
+    return i;
+}
+
+/* guard_free - check the canaries of guarded block bp, then poison its page and put the slot in quarantine */
+static void guard_free(char *bp)
+{
+    unsigned int i;
+    size_t size;
+    char *slot, *p;
+
+    LOCK(&guard_lock);
+    i = guard_slot(bp);
+    size = guard_size[i];
+    guard_size[i] = 0;
+    UNLOCK(&guard_lock);
+    slot = GUARD_SLOT(i);
+    for (p = slot; p < bp; p++)
+	if (*(unsigned char *)p != GUARD_CANARY)
+	    guard_report(bp, size, "canary before a guarded block overwritten (underflow)");
+    for (p = bp + size; p < slot + PAGE_SIZE; p++)
+	if (*(unsigned char *)p != GUARD_CANARY)
+	    guard_report(bp, size, "canary after a guarded block overwritten (overflow)");
+/*any later access through a dangling pointer faults; the slot is reused only after all the other free ones*/
+    memset(slot, GUARD_POISON, PAGE_SIZE);
+    mprotect(slot, PAGE_SIZE, PROT_NONE);
+    LOCK(&guard_lock);
+    guard_fifo[(guard_head + guard_nfree) % MM_GUARD_SLOTS] = i;
+    guard_nfree++;
+    UNLOCK(&guard_lock);
+}
+
+/* guard_realloc - move guarded block bp to a new block of size bytes (not 0), NULL if out of memory */
+static void *guard_realloc(char *bp, size_t size)
+{
+    size_t old;
+    void *newptr;
+
+    LOCK(&guard_lock);
+    old = guard_size[guard_slot(bp)];
+    UNLOCK(&guard_lock);
+/*the block always moves, so a stale pointer to it faults as after a free*/
+    if ((newptr = malloc_block(size)) == NULL)
+	return NULL;
+    memcpy(newptr, bp, MIN(old, size));
+    guard_free(bp);
+    return newptr;
+}
+
+/* guard_report - stop on a misuse of guarded block bp of size bytes */
+static void guard_report(char *bp, size_t size, const char *what)
+{
+    fprintf(stderr, "mm_guard: %s, %zu-byte block at %p\n", what, size, (void *)bp);
+    abort();
+}
+#endif
+
+#if MM_PROF
+/* prof_next - bytes to the next sample, exponentially distributed with mean prof_rate */
+static long prof_next(void)
+{
+    union { double d; uint64_t w; } u;
+    double e, m;
+
+/*u in (0,1] is 2^e (1+m); log2(1+m) is within 0.01 of m (1.3465 - 0.3465 m), close enough for a sampling interval*/
+    u.d = ((sample_rand() >> 11) + 1) * (1.0 / 9007199254740992.0);
+    e = (double)(int)((u.w >> 52) & 0x7ff) - 1023;
+    u.w = (u.w & 0xfffffffffffffULL) | 0x3ff0000000000000ULL;
+    m = u.d - 1;
+    return (long)(-(e + m * (1.3465 - 0.3465 * m)) * 0.6931472 * (double)prof_rate) + 1;
+}
+
+/* prof_mem - size bytes for the profile tables, from mappings of their own; NULL if out of memory */
+static void *prof_mem(size_t size)
+{
+    char *p;
+
+    if (prof_bump + size > prof_end)
+    {
+	if ((p = mmap(NULL, PROF_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	    return NULL;
+	*(char **)p = prof_chunks;
+	prof_chunks = p;
+	prof_bump = p + DSIZE;
+	prof_end = p + PROF_CHUNK;
+    }
+    p = prof_bump;
+    prof_bump += ALIGN(size);
+    return p;
+}
+
+/* prof_reset - forget every sample and stack, for a new heap */
+static void prof_reset(void)
+{
+    char *p;
+
+    while ((p = prof_chunks) != NULL)
+    {
+	prof_chunks = *(char **)p;
+	munmap(p, PROF_CHUNK);
+    }
+    prof_bump = prof_end = NULL;
+    prof_spare = NULL;
+    memset(prof_stacks, 0, sizeof(prof_stacks));
+    memset(prof_recs, 0, sizeof(prof_recs));
+    prof_live = 0;
+    __atomic_add_fetch(&prof_epoch, 1, __ATOMIC_RELAXED);
+}
+
+/* prof_sample - record block bp of size bytes under the call stack that allocated it */
+__attribute__((noinline)) static void prof_sample(void *bp, size_t size)
+{
+    void *pc[PROF_DEPTH + PROF_SKIP];
+    int depth;
+    uint64_t h = 14695981039346656037ULL;
+    prof_stack_t *st;
+    prof_rec_t *r;
+    int i;
+
+/*a thread's first allocation under a rate only draws its interval: prof_left starts at 0, which is no sample point*/
+    if (prof_seen != __atomic_load_n(&prof_epoch, __ATOMIC_RELAXED))
+    {
+	prof_seen = __atomic_load_n(&prof_epoch, __ATOMIC_RELAXED);
+	prof_left = prof_next();
+	return;
+    }
+    prof_left = prof_next();
+    if ((depth = backtrace(pc, PROF_DEPTH + PROF_SKIP) - PROF_SKIP) <= 0)
+	return;
+    for (i = 0; i < depth; i++)
+	h = (h ^ (uintptr_t)pc[PROF_SKIP + i]) * 1099511628211ULL;
+    LOCK(&prof_lock);
+    for (st = prof_stacks[h % PROF_STACK_BUCKETS]; st != NULL; st = st->next)
+	if (st->depth == depth && memcmp(st->pc, pc + PROF_SKIP, depth * sizeof(void *)) == 0)
+	    break;
+    if (st == NULL && (st = prof_mem(sizeof(*st))) != NULL)
+    {
+	memset(st, 0, sizeof(*st));
+	st->depth = depth;
+	memcpy(st->pc, pc + PROF_SKIP, depth * sizeof(void *));
+	st->next = prof_stacks[h % PROF_STACK_BUCKETS];
+	prof_stacks[h % PROF_STACK_BUCKETS] = st;
+    }
+    if ((r = prof_spare) != NULL)
+	prof_spare = r->next;
+    else
+	r = prof_mem(sizeof(*r));
+    if (st == NULL || r == NULL)
+    {
+	UNLOCK(&prof_lock);
+	return;
+    }
+    r->ptr = bp;
+    r->size = size;
+    r->stack = st;
+    r->next = prof_recs[PROF_REC_BUCKET(bp)];
+    prof_recs[PROF_REC_BUCKET(bp)] = r;
+    st->live_n++;
+    st->live_b += size;
+    st->alloc_n++;
+    st->alloc_b += size;
+    __atomic_store_n(&prof_live, prof_live + 1, __ATOMIC_RELAXED);
+    if (IN_HEAP(bp))
+	PAGE_SET(bp, PAGE_PROF);
+    UNLOCK(&prof_lock);
+}
+
+/* prof_free - drop the sample of block ptr, if it has one */
+static void prof_free(void *ptr)
+{
+    prof_rec_t **pp, *r, *q;
+
+    LOCK(&prof_lock);
+    for (pp = &prof_recs[PROF_REC_BUCKET(ptr)]; (r = *pp) != NULL && r->ptr != ptr; pp = &r->next)
+	;
+    if (r != NULL)
+    {
+	*pp = r->next;
+	r->stack->live_n--;
+	r->stack->live_b -= r->size;
+	r->next = prof_spare;
+	prof_spare = r;
+	__atomic_store_n(&prof_live, prof_live - 1, __ATOMIC_RELAXED);
+/*samples of one page share a bucket, so the page keeps its flag while the bucket still holds one of them*/
+	for (q = prof_recs[PROF_REC_BUCKET(ptr)]; q != NULL && PROF_PAGE(q->ptr) != PROF_PAGE(ptr); q = q->next)
+	    ;
+	if (q == NULL && IN_HEAP(ptr))
+	    PAGE_CLR(ptr, PAGE_PROF);
+    }
+    UNLOCK(&prof_lock);
+}
+#endif
+
+/*
+ * mm_prof_dump - write the live samples by allocation stack to path in the legacy pprof heap
+ * format, which pprof scales up from the sampling rate; return 0 on success and -1 otherwise
+ */
+int mm_prof_dump(const char *path)
+{
+#if MM_PROF
+    FILE *f, *maps;
+    prof_stack_t *st;
+    unsigned long live_n = 0, alloc_n = 0;
+    size_t live_b = 0, alloc_b = 0, n;
+    char buf[4096];
+    int i, k;
+
+    if ((f = fopen(path, "w")) == NULL)
+	return -1;
+    LOCK(&prof_lock);
+    for (k = 0; k < PROF_STACK_BUCKETS; k++)
+	for (st = prof_stacks[k]; st != NULL; st = st->next)
+	{
+	    live_n += st->live_n;
+	    live_b += st->live_b;
+	    alloc_n += st->alloc_n;
+	    alloc_b += st->alloc_b;
+	}
+    fprintf(f, "heap profile: %6lu: %8zu [%6lu: %8zu] @ heap_v2/%lu\n", live_n, live_b, alloc_n, alloc_b, prof_rate);
+    for (k = 0; k < PROF_STACK_BUCKETS; k++)
+	for (st = prof_stacks[k]; st != NULL; st = st->next)
+	{
+	    fprintf(f, "%6lu: %8zu [%6lu: %8zu] @", st->live_n, st->live_b, st->alloc_n, st->alloc_b);
+	    for (i = 0; i < st->depth; i++)
+		fprintf(f, " %p", st->pc[i]);
+	    fputc('\n', f);
+	}
+    UNLOCK(&prof_lock);
+/*pprof maps the addresses to symbols with the mappings of the process*/
+    fputs("\nMAPPED_LIBRARIES:\n", f);
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL)
+    {
+	while ((n = fread(buf, 1, sizeof(buf), maps)) > 0)
+	    fwrite(buf, 1, n, f);
+	fclose(maps);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+/*
+ * mmap_alloc - give a request of size bytes a mapping of its own, outside the heap, with a
+ * payload that is a multiple of align (a power of two)
+ */
+static void *mmap_alloc(size_t size, size_t align)
+{
+    size_t off = align > PAGE_SIZE ? PAGE_SIZE : MAX(align, DSIZE); /*of the payload in the mapping*/
+    size_t len = PAGE_ALIGN(size + off);
+    size_t extra = align > PAGE_SIZE ? align - PAGE_SIZE : 0;
+    char *m, *start, *bp;
+
+    if ((m = mmap(NULL, len + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	return NULL;
+/*alignments above the page size map extra pages, then unmap the ones on either side of the block*/
+    start = (char *)(((uintptr_t)m + off + align - 1) & ~(uintptr_t)(align - 1)) - off;
+    if (start > m)
+	munmap(m, start - m);
+    if (start < m + extra)
+	munmap(start + len, m + extra - start);
+    bp = start + off;
+    MMAP_OFFSET(bp) = off;
+    PUT(HDRP(bp), PACK(len, 1 | MMAPPED));
+    STAT_ADD(mapped_bytes, len);
+    return bp;
+}
+
+/* mmap_free - unmap a mapped block */
+static void mmap_free(void *bp)
+{
+    STAT_ADD(mapped_bytes, -(size_t)GET_SIZE(HDRP(bp)));
+    munmap(MMAP_START(bp), GET_SIZE(HDRP(bp)));
+}
+
+/* mmap_realloc - resize a mapped block to hold size bytes, letting the kernel move the pages rather than copying them */
+static void *mmap_realloc(void *bp, size_t size)
+{
+    size_t off = MMAP_OFFSET(bp);
+    size_t len = PAGE_ALIGN(size + off);
+    char *m;
+
+#ifdef MREMAP_MAYMOVE
+    if ((m = mremap(MMAP_START(bp), GET_SIZE(HDRP(bp)), len, MREMAP_MAYMOVE)) == MAP_FAILED)
+	return NULL;
+    STAT_ADD(mapped_bytes, len - GET_SIZE(HDRP(m + off)));
+    bp = m + off;
+    PUT(HDRP(bp), PACK(len, 1 | MMAPPED));
+    return bp;
+#else
+    (void)m;
+    (void)len;
+    return NULL;
+#endif
+}
+
+/*
+ * release_pages - give the OS the whole pages of free block bp past its first keep bytes,
+ * sparing the links and footer; return 1 if any page was released.  With huge pages on, only
+ * whole huge pages go, so that no huge page is broken up.
+ */
+static int release_pages(void *bp, size_t keep)
+{
+    if (keep >= GET_SIZE(HDRP(bp)))
+	return 0;
+    return release_span(bp, heap_base + HEAP_ALIGN((char *)bp + keep - heap_base), FTRP(bp));
+}
+
+/* release_span - release_pages for the pages of free block bp that touch [from,to) */
+static int release_span(void *bp, char *from, char *to)
+{
+    size_t mask = (hugepages ? HUGE_SIZE : PAGE_SIZE) - 1;
+    size_t lo = MAX((size_t)(from - heap_base) & ~mask, HEAP_ALIGN((char *)bp + FREE_META - heap_base));
+    size_t hi = MIN(((size_t)(to - heap_base) + mask) & ~mask, ((char *)FTRP(bp) - heap_base) & ~mask);
+
+    if (hi <= lo)
+	return 0;
+#if MM_PERSIST
+/*the pages of a file heap only go by punching a hole in the file, which reads back as zeros*/
+    if (persist_fd >= 0)
+    {
+	madvise(heap_base + lo, hi - lo, MADV_REMOVE);
+	return 1;
+    }
+#endif
+    madvise(heap_base + lo, hi - lo, MADV_RELEASE);
+    return 1;
+}
+
+/* tree_release - release_pages for every block of the treap rooted at t, see mm_trim */
+static int tree_release(arena_t *a, char *t, size_t pad)
+{
+    int released;
+
+    if (t == NULL)
+	return 0;
+    released = release_pages(t, NEXT_BLKP(t) == a->epilogue + WSIZE ? pad : 0);
+    released |= tree_release(a, TREE_LEFT(t), pad);
+    return tree_release(a, TREE_RIGHT(t), pad) | released;
+}
+
+/*
+ * mm_trim - release the pages of every free block, keeping pad bytes of each arena's top
+ * block resident for the next requests; return 1 if any memory was released
+ */
+int mm_trim(size_t pad)
+{
+    int i, k, released = 0;
+    arena_t *a;
+    char *bp;
+
+#if MM_THREADS
+    tcache_flush(&tcache);
+#endif
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+	a = &arenas[i];
+	if (a->heap_listp == NULL)
+	    continue;
+	arena_lock(a);
+	fast_consolidate(a);
+	for (k = 0; k < NUM_CLASSES; k++)
+	    for (bp = a->free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+		released |= release_pages(bp, NEXT_BLKP(bp) == a->epilogue + WSIZE ? pad : 0);
+	released |= tree_release(a, a->tree, pad);
+	UNLOCK(&a->lock);
+    }
+    return released;
+}
+
+#if MM_STATS
+/* block_bytes - bytes taken by allocated block or slab object ptr, header included */
+static size_t block_bytes(void *ptr)
+{
+#if MM_GUARD
+    if (IN_GUARD(ptr))
+	return PAGE_SIZE;
+#endif
+    if (IS_SLAB(ptr))
+	return SLAB_SIZE(((slab_t *)SLAB_RUN(ptr))->cls);
+    return GET_SHARED_SIZE(HDRP(ptr));
+}
+#endif
+
+/* tree_stats - add the blocks of the treap rooted at t to the free-space figures of st */
+static void tree_stats(char *t, struct mm_stats *st)
+{
+    if (t == NULL)
+	return;
+    st->free_bytes += GET_SIZE(HDRP(t));
+    st->free_blocks++;
+    st->largest_free = MAX(st->largest_free, GET_SIZE(HDRP(t)));
+    tree_stats(TREE_LEFT(t), st);
+    tree_stats(TREE_RIGHT(t), st);
+}
+
+/*
+ * mm_get_stats - fill st with the heap and free-space figures, and the operation counters when
+ * built with MM_STATS (zero otherwise); return 1 if the counters are kept
+ */
+int mm_get_stats(struct mm_stats *st)
+{
+    int i, k;
+    arena_t *a;
+    char *bp;
+
+#if MM_STATS
+    *st = stats;
+#else
+    memset(st, 0, sizeof(*st));
+#endif
+    st->heap_bytes = heap_brk - heap_base;
+    st->free_bytes = st->free_blocks = st->largest_free = 0;
+    for (i = 0; i < MM_NARENAS; i++)
+    {
+	a = &arenas[i];
+	LOCK(&a->lock);
+	for (k = 0; k < NUM_CLASSES; k++)
+	    for (bp = a->free_lists[k]; bp != NULL; bp = NEXT_FREE(bp))
+	    {
+		st->free_bytes += GET_SIZE(HDRP(bp));
+		st->free_blocks++;
+		st->largest_free = MAX(st->largest_free, GET_SIZE(HDRP(bp)));
+	    }
+	tree_stats(a->tree, st);
+	UNLOCK(&a->lock);
+    }
+/*all the free space in one block is no fragmentation at all, in many small blocks close to 1*/
+    st->fragmentation = st->free_bytes ? 1.0 - (double)st->largest_free / st->free_bytes : 0.0;
+    return MM_STATS;
+}
+
+#if MM_TRACE
+static uint64_t trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* trace_write - write len bytes to the trace file, return -1 on an error */
+static int trace_write(const void *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0)
+    {
+	if ((n = write(trace_fd, buf, len)) < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	buf = (const char *)buf + n;
+	len -= n;
+    }
+    return 0;
+}
+
+/* trace_drain - write out the records of ring r, the caller holds trace_lock */
+static void trace_drain(trace_ring_t *r)
+{
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->tail;
+    size_t i, n;
+
+    while (tail < head)
+    {
+	i = tail % TRACE_RING;
+	n = MIN(head - tail, TRACE_RING - i);
+	if (trace_fd < 0 || trace_write(&r->recs[i], n * sizeof(struct mm_trace_rec)) < 0)
+	    break;
+	tail += n;
+    }
+/*records that could not be written are dropped rather than block their thread forever*/
+    __atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+}
+
+/* trace_flush - write out every ring and unmap those of exited threads */
+static void trace_flush(void)
+{
+    trace_ring_t **rp, *r;
+
+    pthread_mutex_lock(&trace_lock);
+    for (rp = &trace_rings; (r = *rp) != NULL; )
+    {
+	trace_drain(r);
+	if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) && r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+	{
+	    *rp = r->next;
+	    munmap(r, sizeof(trace_ring_t));
+	}
+	else
+	    rp = &r->next;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* trace_loop - body of the flusher thread */
+static void *trace_loop(void *arg)
+{
+    struct timespec ts = { 0, TRACE_FLUSH_NS };
+
+    (void)arg;
+    while (!__atomic_load_n(&trace_stopping, __ATOMIC_ACQUIRE))
+    {
+	nanosleep(&ts, NULL);
+	trace_flush();
+    }
+    return NULL;
+}
+
+/* trace_exit - thread-exit destructor: the flusher unmaps the ring once it is written out */
+static void trace_exit(void *r)
+{
+    trace_ring = NULL;
+    __atomic_store_n(&((trace_ring_t *)r)->dead, 1, __ATOMIC_RELEASE);
+}
+
+/* trace_atexit - finish a trace still running when the program exits */
+static void trace_atexit(void)
+{
+    mm_trace_stop();
+}
+
+static void trace_key_init(void)
+{
+    pthread_key_create(&trace_key, trace_exit);
+    atexit(trace_atexit);
+}
+
+/* trace_rec - append a record to the calling thread's ring */
+static void trace_rec(int op, size_t size, void *ptr, void *old)
+{
+    trace_ring_t *r = trace_ring;
+    struct mm_trace_rec *rec;
+    uint64_t h;
+
+    if (r == NULL)
+    {
+	if ((r = mmap(NULL, sizeof(trace_ring_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	    return;
+	r->tid = __atomic_add_fetch(&trace_tids, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&trace_lock);
+	r->next = trace_rings;
+	trace_rings = r;
+	pthread_mutex_unlock(&trace_lock);
+	pthread_setspecific(trace_key, r);
+	trace_ring = r;
+    }
+    h = r->head;
+    if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == TRACE_RING)
+    {
+/*the flusher is behind: write the ring out here rather than lose records*/
+	pthread_mutex_lock(&trace_lock);
+	trace_drain(r);
+	pthread_mutex_unlock(&trace_lock);
+    }
+    rec = &r->recs[h % TRACE_RING];
+    rec->ts = trace_now() - trace_t0;
+    rec->size = size;
+    rec->ptr = (uintptr_t)ptr;
+    rec->old = (uintptr_t)old;
+    rec->tid = r->tid;
+    rec->op = op;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+/*
+ * mm_trace_start - record every malloc, free and realloc to the file at path, return 0 on
+ * success and -1 if a trace is already running, the file cannot be created or the package
+ * was built without MM_TRACE
+ */
+int mm_trace_start(const char *path)
+{
+#if MM_TRACE
+    struct mm_trace_hdr hdr = { MM_TRACE_MAGIC, MM_TRACE_VERSION, sizeof(struct mm_trace_rec) };
+
+    pthread_once(&trace_once, trace_key_init);
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0 || (trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+	pthread_mutex_unlock(&trace_lock);
+	return -1;
+    }
+    trace_stopping = 0;
+    if (trace_write(&hdr, sizeof(hdr)) < 0 || pthread_create(&trace_flusher, NULL, trace_loop, NULL) != 0)
+    {
+	close(trace_fd);
+	trace_fd = -1;
+	pthread_mutex_unlock(&trace_lock);
+	return -1;
+    }
+    trace_t0 = trace_now();
+    __atomic_store_n(&trace_on, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+/*
+ * mm_trace_stop - stop recording and write out what is left, return -1 if no trace was running;
+ * a call racing with the stop may or may not be recorded
+ */
+int mm_trace_stop(void)
+{
+#if MM_TRACE
+    int fd;
+
+    pthread_mutex_lock(&trace_lock);
+    fd = trace_fd;
+    pthread_mutex_unlock(&trace_lock);
+    if (fd < 0 || !__atomic_exchange_n(&trace_on, 0, __ATOMIC_ACQ_REL))
+	return -1;
+    __atomic_store_n(&trace_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(trace_flusher, NULL);
+    trace_flush();
+    pthread_mutex_lock(&trace_lock);
+    close(trace_fd);
+    trace_fd = -1;
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_mallopt - set an allocator parameter (see mm_ext.h), return 1 on success
+ */
+int mm_mallopt(int param, long value)
+{
+#if MM_TLSF
+/*the real-time engine keeps one policy on a fixed pool: nothing may add a search or a system call*/
+    if (param != MM_PREFAULT && param != MM_HUGEPAGE)
+	return 0;
+#endif
+#if MM_PERSIST
+    if (persist_fd >= 0 && (param == MM_MMAP_THRESHOLD || param == MM_GUARD_RATE || param == MM_HUGEPAGE))
+	return 0;
+#endif
+    switch (param)
+    {
+    case MM_MMAP_THRESHOLD:
+	if (value < 0)
+	    return 0;
+	mmap_threshold = value == 0 ? (size_t)-1 : (size_t)value;
+	return 1;
+    case MM_TRIM_THRESHOLD:
+	if (value < 0)
+	    return 0;
+	trim_threshold = value == 0 ? (size_t)-1 : (size_t)value;
+	return 1;
+    case MM_PLACEMENT:
+	if (value < MM_FIRST_FIT || value > MM_ADDR_BEST_FIT)
+	    return 0;
+	placement = (int)value;
+	return 1;
+    case MM_FAST_MAX:
+	if (value < 0 || value > FAST_LIMIT)
+	    return 0;
+	fast_max = (size_t)value;
+	return 1;
+    case MM_GROW_MAX:
+	if (value < 0)
+	    return 0;
+	grow_max = value == 0 ? CHUNKSIZE : PAGE_ALIGN((size_t)value);
+	return 1;
+    case MM_PREFAULT:
+	prefault = value != 0;
+	return 1;
+#if MM_PROF
+    case MM_PROF_RATE:
+	if (value < 0)
+	    return 0;
+	prof_rate = (unsigned long)value;
+	__atomic_add_fetch(&prof_epoch, 1, __ATOMIC_RELAXED);
+	return 1;
+#endif
+#if MM_GUARD
+    case MM_GUARD_RATE:
+	if (value < 0)
+	    return 0;
+	guard_rate = (unsigned long)value;
+	return 1;
+#endif
+    case MM_HUGEPAGE:
+/*the heap base is aligned at mm_init; address-ordered fits pack blocks into the low huge pages, leaving high ones free whole*/
+	hugepages = value != 0;
+	if (hugepages)
+	    placement = MM_ADDR_BEST_FIT;
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * adjust_size - block size for a request of size bytes: payload plus header, aligned,
+ * and never smaller than a free block (header, two links and footer)
+ */
+static size_t adjust_size(size_t size)
+{
+    if (size <= DSIZE + WSIZE)
+	return 2*DSIZE;
+    return DSIZE * ((size + (WSIZE)+ (DSIZE-1))/DSIZE);
+}
+
+/* arena_malloc - allocate a block of asize bytes from arena a, the caller holds its lock */
+static void *arena_malloc(arena_t *a, size_t asize)
+{
+    char *bp;
+
+/*a fast-bin block of the exact size is still marked allocated, so it needs no place*/
+    if (asize <= fast_max && (bp = a->fast[asize / DSIZE]) != NULL)
+    {
+	a->fast[asize / DSIZE] = *(char **)bp;
+	a->fast_bytes -= asize;
+	return bp;
+    }
+
+    /*Search the free list for a fit, merging the fast bins first if there is none */
+    if ((bp = find_fit(a, asize)) != NULL || (fast_consolidate(a) && (bp = find_fit(a, asize)) != NULL))
+    {
+	place(a, bp,asize);
+	return bp;
+    }
+
+    /*no fit found get more memory and place the block*/
+    if ((bp = grow_heap(a, asize)) == NULL)
+	return NULL;
+    place(a, bp, asize);
+    return bp;
+}
+
+/* 
+ * arena_malloc_batch - carve up to n blocks of asize bytes for out from as few free blocks
+ * (or heap extensions) as possible, the caller holds the lock of a; return how many were made
+ */
+static size_t arena_malloc_batch(arena_t *a, size_t asize, size_t n, void **out)
+{
+    size_t k = 0, want, csize, prev_alloc, most = MAX_REQUEST / asize;
+    char *bp;
+
+    while (k < n)
+    {
+	want = MIN(n - k, most) * asize;
+/*one region for the whole rest of the batch, else any block that takes at least one*/
+	if ((bp = find_fit(a, want)) == NULL && (bp = find_fit(a, asize)) == NULL)
+	{
+	    if (fast_consolidate(a))
+		continue;
+/*a heap that cannot grow by the whole rest may still grow by less: halve the region down to one block, and search again since part of the growth may have been kept*/
+	    if ((bp = grow_heap(a, want)) == NULL)
+	    {
+		if (want == asize)
+		    break;
+		most = MAX(want / asize / 2, 1);
+		continue;
+	    }
+	}
+	remove_free_block(a, bp);
+	csize = GET_SIZE(HDRP(bp));
+	prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	for (; k < n - 1 && csize - asize >= asize; k++)
+	{
+	    PUT(HDRP(bp), PACK(asize, 1 | prev_alloc));
+	    out[k] = bp;
+	    prev_alloc = PREV_ALLOC;
+	    csize -= asize;
+	    bp = NEXT_BLKP(bp);
+	}
+/*the last block takes what is left, place splits the remainder off as usual*/
+	PUT(HDRP(bp), PACK(csize, 1 | prev_alloc));
+	place(a, bp, asize);
+	out[k++] = bp;
+    }
+    return k;
+}
+
+/* 
+ * mm_malloc - Allocate a block by incrementing the brk pointer.
+ *     Always allocate a block whose size is a multiple of the alignment.
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp = malloc_block(size);
+
+    STAT_ADD(mallocs, 1);
+#if MM_STATS
+    if (bp != NULL)
+	STAT_ADD(live_bytes, block_bytes(bp));
+#endif
+    if (bp != NULL)
+	TRACE(MM_TRACE_MALLOC, size, bp, NULL);
+    PROF_MALLOC(bp, size);
+    CHECK_TICK();
+    return bp;
+}
+
+/*
+ * mm_malloc_onnode - mm_malloc from the first arena of NUMA node node, for a buffer that must
+ * stay there whichever thread allocates it; a huge block's mapping is bound to the node.  NULL
+ * for a node the allocator does not know; without MM_NUMA, any node gets a plain mm_malloc.
+ */
+void *mm_malloc_onnode(size_t size, int node)
+{
+#if MM_NUMA
+    arena_t *a;
+    void *bp = NULL;
+
+    if (node < 0 || (unsigned int)node >= numa_nodes || size == 0 || size > MAX_REQUEST)
+	return NULL;
+    a = &arenas[node];
+    if (size >= mmap_threshold)
+    {
+	if ((bp = mmap_alloc(size, DSIZE)) != NULL)
+	    numa_bind(MMAP_START(bp), GET_SIZE(HDRP(bp)), node, MPOL_MF_MOVE);
+    }
+    else
+    {
+/*the thread cache is skipped, its blocks may come from any arena*/
+	arena_lock(a);
+	if (a->heap_listp != NULL || arena_init(a) == 0)
+	    bp = !MM_TLSF && size <= SLAB_MAX ? slab_alloc(a, slab_class(size)) : arena_malloc(a, adjust_size(size));
+	UNLOCK(&a->lock);
+    }
+    STAT_ADD(mallocs, 1);
+#if MM_STATS
+    if (bp != NULL)
+	STAT_ADD(live_bytes, block_bytes(bp));
+#endif
+    if (bp != NULL)
+	TRACE(MM_TRACE_MALLOC, size, bp, NULL);
+    PROF_MALLOC(bp, size);
+    CHECK_TICK();
+    return bp;
+#else
+    (void)node;
+    return mm_malloc(size);
+#endif
+}
+
+/* malloc_block - the work of mm_malloc */
+static void *malloc_block(size_t size)
+{
+    size_t asize; /*adjusted block size*/
+    arena_t *a;
+    char *bp;
+    
+    /*ignore spurious requests*/
+    if (size == 0 || size > MAX_REQUEST)
+	return NULL;
+#if MM_GUARD
+    if (guard_rate != 0 && size <= GUARD_MAX && guard_sample() && (bp = guard_alloc(size)) != NULL)
+	return bp;
+#endif
+
+    /*small requests are slab objects, without any header*/
+    if (!MM_TLSF && size <= SLAB_MAX)
+    {
+	int cls = slab_class(size);
+#if MM_THREADS
+	if ((bp = tcache_get(TCACHE_SLAB_BIN(cls))) != NULL)
+	    return bp;
+	if ((a = thread_arena_get()) == NULL)
+	    return NULL;
+#else
+	a = &arenas[0];
+#endif
+	arena_lock(a);
+	bp = slab_alloc(a, cls);
+	UNLOCK(&a->lock);
+	return bp;
+    }
+
+    /*huge requests get their own mapping so that their memory goes back to the OS on free*/
+    if (size >= mmap_threshold)
+	return mmap_alloc(size, DSIZE);
+
+    /*ADJUST BLOCK SIZE TO INCLUDE OVERHEAD AND ALIGNMENT REQS. */
+    asize = adjust_size(size);
+
+#if MM_THREADS
+    /*recently freed block of this size in the thread cache: no lock at all*/
+    if (asize <= TCACHE_MAX && (bp = tcache_get(asize / DSIZE)) != NULL)
+	return bp;
+    if ((a = thread_arena_get()) == NULL)
+	return NULL;
+#else
+    a = &arenas[0];
+#endif
+    arena_lock(a);
+    bp = arena_malloc(a, asize);
+    UNLOCK(&a->lock);
+    return bp;
+}
+
+/*
+ * mm_memalign - allocate size bytes at a multiple of alignment, a power of two.  The block is
+ * placed at an aligned payload inside a free block, and the space in front of it goes back to
+ * the free lists as a free block of its own.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    void *bp = memalign_block(alignment, size);
+
+    STAT_ADD(mallocs, 1);
+#if MM_STATS
+    if (bp != NULL)
+	STAT_ADD(live_bytes, block_bytes(bp));
+#endif
+    if (bp != NULL)
+	TRACE(MM_TRACE_MALLOC, size, bp, NULL);
+    PROF_MALLOC(bp, size);
+    CHECK_TICK();
+    return bp;
+}
+
+/* mm_aligned_alloc - C11 aligned_alloc: mm_memalign under the standard's name */
+void *mm_aligned_alloc(size_t alignment, size_t size)
+{
+    return mm_memalign(alignment, size);
+}
+
+/* memalign_block - the work of mm_memalign */
+static void *memalign_block(size_t align, size_t size)
+{
+    size_t asize;
+    arena_t *a;
+    char *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0)
+	return NULL;
+/*slab classes start at ALIGNMENT (see SLAB_SIZE), so anything malloc_block returns is that aligned*/
+    if (align <= ALIGNMENT)
+	return malloc_block(size);
+    if (size == 0 || size > MAX_REQUEST - align)
+	return NULL;
+    if (size >= mmap_threshold)
+	return mmap_alloc(size, align);
 
-#include "mm.h"
-#include "memlib.h"
+/*slab objects are only ALIGNMENT aligned, so even small requests with a larger alignment take a heap block*/
+    asize = adjust_size(size);
+#if MM_THREADS
+    if ((a = thread_arena_get()) == NULL)
+	return NULL;
+#else
+    a = &arenas[0];
+#endif
+    arena_lock(a);
+/*an extension that big holds an aligned payload whatever its start*/
+    if ((bp = find_aligned_fit(a, asize, align)) != NULL ||
+	(fast_consolidate(a) && (bp = find_aligned_fit(a, asize, align)) != NULL) ||
+	(bp = grow_heap(a, asize + align + 2*DSIZE)) != NULL)
+	bp = place_aligned(a, bp, asize, align);
+    UNLOCK(&a->lock);
+    return bp;
+}
 
+/* arena_free - free block bp of arena a, the caller holds its lock */
+static void arena_free(arena_t *a, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *merged;
+/*a free neighbour past the threshold gave its pages back when it got there, do not madvise them again*/
+    int resident = (!GET_PREV_ALLOC(HDRP(bp)) && GET_SIZE((char *)bp - DSIZE) < trim_threshold) ||
+	(!GET_ALLOC(HDRP(NEXT_BLKP(bp))) && GET_SIZE(HDRP(NEXT_BLKP(bp))) < trim_threshold);
 
+    PUT(HDRP(bp),PACK(size,GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp),GET(HDRP(bp)));
+    merged = coalesce(a, bp);
+/*a large free block hands its pages back rather than staying resident until it is reused*/
+    if (GET_SIZE(HDRP(merged)) >= trim_threshold)
+    {
+	if (resident)
+	    release_pages(merged, 0);
+	else
+	    release_span(merged, bp, (char *)bp + size);
+    }
+}
 
-/* Basic constants and macros */
-#define WSIZE 4 /*Word and header/footer size (bytes) */
-#define DSIZE 8 /*Double word size (bytes) */
-#define CHUNKSIZE (1<<12) /*Extend heap by this amount (bytes)*/
+/* fast_put - defer the free of block bp of arena a to its fast bin, the caller holds the lock */
+static void fast_put(arena_t *a, char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
 
-#define MAX(x,y) ((x)>(y)?(x):(y))
+    *(char **)bp = a->fast[size / DSIZE];
+    a->fast[size / DSIZE] = bp;
+    a->fast_bytes += size;
+    if (a->fast_bytes > FAST_BYTES)
+	fast_consolidate(a);
+}
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc) ((size) | (alloc))
+/* fast_consolidate - free and coalesce every block of the fast bins of a, return 0 if they were empty */
+static int fast_consolidate(arena_t *a)
+{
+    unsigned int i;
+    char *bp;
 
-/*Read and write a word at address p */
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p)=(val))
+    if (a->fast_bytes == 0)
+	return 0;
+    for (i = 0; i < FAST_BINS; i++)
+    {
+	while ((bp = a->fast[i]) != NULL)
+	{
+	    a->fast[i] = *(char **)bp;
+	    arena_free(a, bp);
+	}
+    }
+    a->fast_bytes = 0;
+    return 1;
+}
 
-/*Read the size and allocated fields from address p*/
-#define GET_SIZE(p) (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
+/* free_to_arena - free a block or slab object under the lock of the arena owning it */
+static void free_to_arena(void *ptr)
+{
+    arena_t *a = block_arena(IS_SLAB(ptr) ? SLAB_RUN(ptr) : (char *)ptr);
 
-/*Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp) ((char*)(bp) - WSIZE)
-#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+#if MM_THREADS
+/*another thread's arena: queue the block for it instead of taking its lock*/
+    if (a != thread_arena)
+    {
+	remote_push(a, ptr);
+	return;
+    }
+#endif
+    arena_lock(a);
+    arena_release(a, ptr);
+    UNLOCK(&a->lock);
+}
 
-/*Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
-#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+/* arena_release - free a block or slab object of arena a, the caller holds its lock */
+static void arena_release(arena_t *a, char *ptr)
+{
+    if (IS_SLAB(ptr))
+	slab_free(a, SLAB_RUN(ptr), ptr);
+    else if (GET_SIZE(HDRP(ptr)) <= fast_max)
+	fast_put(a, ptr);
+    else
+	arena_free(a, ptr);
+}
 
-#define ALIGNMENT 8
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-#define SIZE_T_SIZE 4
+#if MM_THREADS
+/* remote_push - queue ptr on the remote-free list of a with a single CAS, without its lock */
+static void remote_push(arena_t *a, char *ptr)
+{
+    char *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
 
-/*a global variable that always points to the prologue block */
-static char *heap_listp = 0;
-static char *previous = 0;
+    do
+	*(char **)ptr = head;
+    while (!__atomic_compare_exchange_n(&a->remote, &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    STAT_ADD(remote_frees, 1);
+}
 
-/* Prototypes for helper methods */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
+/* remote_drain - free every block other threads queued for a, the caller holds its lock */
+static void remote_drain(arena_t *a)
+{
+/*taking the whole list at once leaves no ABA window: producers only ever push*/
+    char *bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE), *next;
+
+    for (; bp != NULL; bp = next)
+    {
+	next = *(char **)bp;
+	arena_release(a, bp);
+    }
+}
+#endif
+
+/* arena_lock - take the lock of arena a, then free what other threads have queued for it */
+static void arena_lock(arena_t *a)
+{
+    LOCK(&a->lock);
+    PERSIST_DIRTY();
+#if MM_THREADS
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) != NULL)
+	remote_drain(a);
+#else
+    (void)a;
+#endif
+}
 
 /*
- *  * mm_check heap consistency checker, see if an implicit free list is correctly linked and implemented
- *   */
+ * mm_free - Freeing a block changes the alloctated bit to status 0, a slab object goes back to its run
+ * and a mapped block is unmapped
+ */
+void mm_free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    STAT_ADD(frees, 1);
+    STAT_ADD(live_bytes, -block_bytes(ptr));
+    TRACE(MM_TRACE_FREE, 0, ptr, NULL);
+    PROF_FREE(ptr);
+    free_block(ptr);
+    CHECK_TICK();
+}
 
+/* free_block - the work of mm_free, for a block that is not NULL */
+static void free_block(void *ptr)
+{
+#if MM_GUARD
+    if (IN_GUARD(ptr))
+    {
+	guard_free(ptr);
+	return;
+    }
+#endif
+    if (!IS_SLAB(ptr) && GET_MMAPPED(HDRP(ptr)))
+    {
+	mmap_free(ptr);
+	return;
+    }
+#if MM_THREADS
+    if (IS_SLAB(ptr))
+    {
+	if (tcache_put(ptr, TCACHE_SLAB_BIN(((slab_t *)SLAB_RUN(ptr))->cls)))
+	    return;
+    }
+/*read without the arena lock: a neighbour may flip our prev-alloc bit, but the size of an allocated block never changes*/
+    else if (GET_SHARED_SIZE(HDRP(ptr)) <= TCACHE_MAX && tcache_put(ptr, GET_SHARED_SIZE(HDRP(ptr)) / DSIZE))
+	return;
+#endif
+    free_to_arena(ptr);
+}
 
-int mm_check(void)
+/*
+ * mm_malloc_batch - allocate up to n blocks of size bytes into out, carving the heap blocks
+ * from one free region under a single lock; return how many were allocated
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
 {
-    void *heap_start = mem_heap_lo();
-    void *heap_end = (char*)mem_heap_hi()+1;
-    void *t = HDRP(NEXT_BLKP(heap_listp));
-    while (t!=heap_end)
+    size_t k = 0, i;
+    arena_t *a;
+
+    if (size == 0 || size > MAX_REQUEST)
+	return 0;
+    if (size >= mmap_threshold)
     {
-        int *header = (int *)t;
-        int size = (*header)&(~0x1);
-/*check that the blocks are correctly aligned*/
-        if (size %8 != 0)
-        {
-           printf("not multiple of 8!");
-           return 1;
-        }
-/*check that no free blocks are contiguous*/
-	if (GET_ALLOC(HDRP(t))==1 && GET_ALLOC(HDRP(NEXT_BLKP(t)))==1)
-	{
-	   printf("Two consecutive free blocks!");
-           return 1;
-        }
-/*check that pointers in heap block are valid heap addresses.*/
-	if (t<heap_start||t>heap_end)
-        {
-           printf("Invalid heap addresses");
-           return 1;
-        }
-/*check for no overlapping between blocks*/
-	if (t == HDRP(NEXT_BLKP(t)))
+	while (k < n && (out[k] = mmap_alloc(size, DSIZE)) != NULL)
+	    k++;
+    }
+    else
+    {
+#if MM_THREADS
+	if ((a = thread_arena_get()) == NULL)
+	    return 0;
+#else
+	a = &arenas[0];
+#endif
+	arena_lock(a);
+	if (!MM_TLSF && size <= SLAB_MAX)
 	{
-	   printf("overlapped blocks!");
-           return 1;
-        }
-        t = HDRP(NEXT_BLKP(t));
+	    int cls = slab_class(size);
+	    while (k < n && (out[k] = slab_alloc(a, cls)) != NULL)
+		k++;
+	}
+	else
+	    k = arena_malloc_batch(a, adjust_size(size), n, out);
+	UNLOCK(&a->lock);
     }
-    return 0;
+    for (i = 0; i < k; i++)
+    {
+	STAT_ADD(mallocs, 1);
+	STAT_ADD(live_bytes, block_bytes(out[i]));
+	TRACE(MM_TRACE_MALLOC, size, out[i], NULL);
+	PROF_MALLOC(out[i], size);
+    }
+    return k;
 }
 
-/* mm_coalesce - coalesce freed blocks */
-static void *coalesce(void *bp)
+/* ptr_cmp - qsort order of block pointers by address */
+static int ptr_cmp(const void *p, const void *q)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    char *x = *(char * const *)p, *y = *(char * const *)q;
 
-    if (prev_alloc && next_alloc)
-        {return bp;}
+    return (x > y) - (x < y);
+}
 
-    else if (prev_alloc && !next_alloc)
+/*
+ * mm_free_batch - free the n blocks of ptrs (NULL entries are skipped).  The array is sorted
+ * by address so that runs of adjacent blocks are freed and coalesced as one block, and each
+ * arena lock is taken once per run of its blocks.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    arena_t *a = NULL, *b;
+    size_t i, j, total;
+    char *bp;
+
+    for (i = 0; i < n; i++)
     {
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+	if (ptrs[i] == NULL)
+	    continue;
+	STAT_ADD(frees, 1);
+	STAT_ADD(live_bytes, -block_bytes(ptrs[i]));
+	TRACE(MM_TRACE_FREE, 0, ptrs[i], NULL);
+	PROF_FREE(ptrs[i]);
     }
-
-    else if (!prev_alloc && next_alloc)
+    qsort(ptrs, n, sizeof(*ptrs), ptr_cmp);
+    for (i = 0; i < n; i = j)
     {
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+	bp = ptrs[i];
+	j = i + 1;
+	if (bp == NULL)
+	    continue;
+#if MM_GUARD
+	if (IN_GUARD(bp))
+	{
+	    guard_free(bp);
+	    continue;
+	}
+#endif
+	if (!IS_SLAB(bp) && GET_MMAPPED(HDRP(bp)))
+	{
+	    mmap_free(bp);
+	    continue;
+	}
+	b = block_arena(IS_SLAB(bp) ? SLAB_RUN(bp) : bp);
+	if (b != a)
+	{
+#if MM_THREADS
+	    if (a != NULL)
+		UNLOCK(&a->lock);
+	    LOCK(&b->lock);
+#endif
+	    PERSIST_DIRTY();
+	    a = b;
+	}
+	if (IS_SLAB(bp))
+	{
+	    slab_free(a, SLAB_RUN(bp), bp);
+	    continue;
+	}
+/*blocks that follow each other in memory become one allocated block, freed with a single coalesce*/
+	total = GET_SIZE(HDRP(bp));
+	while (j < n && (char *)ptrs[j] == bp + total)
+	{
+	    CHECK_MERGED(a, ptrs[j], bp);
+	    total += GET_SIZE(HDRP(ptrs[j++]));
+	}
+	PUT(HDRP(bp), PACK(total, 1 | GET_PREV_ALLOC(HDRP(bp))));
+	arena_free(a, bp);
     }
+#if MM_THREADS
+    if (a != NULL)
+	UNLOCK(&a->lock);
+#endif
+}
 
-    else
+/*
+ * mm_free_sized - free ptr, whose size is at least the size it was allocated with and at most
+ * mm_usable_size(ptr).  The size picks the thread-cache bin, so a cached free reads no header.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+	return;
+    STAT_ADD(frees, 1);
+    STAT_ADD(live_bytes, -block_bytes(ptr));
+    TRACE(MM_TRACE_FREE, 0, ptr, NULL);
+    PROF_FREE(ptr);
+#if MM_GUARD
+    if (IN_GUARD(ptr))
     {
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+	guard_free(ptr);
+	return;
     }
-/*fix the next pointer to prevent it from being erased by coalesce*/
-    if ((char *)previous > (char *)bp && previous < NEXT_BLKP(bp))
-	previous = bp;
+#endif
+/*the address alone tells a mapped block from a heap one*/
+    if (!IN_HEAP(ptr))
+    {
+	mmap_free(ptr);
+	return;
+    }
+#if MM_THREADS
+/*a smaller bin than the block's own only means it may serve a smaller request*/
+    if (IS_SLAB(ptr))
+    {
+	if (tcache_put(ptr, TCACHE_SLAB_BIN(slab_class(size))))
+	    return;
+    }
+    else if (size <= TCACHE_MAX - WSIZE && tcache_put(ptr, adjust_size(size) / DSIZE))
+	return;
+#else
+    (void)size;
+#endif
+    free_to_arena(ptr);
+}
 
-    return bp;
+/* mm_usable_size - bytes of ptr the caller may use, which can be more than it asked for; 0 for NULL */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+	return 0;
+#if MM_GUARD
+/*the canaries start right after the size asked for*/
+    if (IN_GUARD(ptr))
+	return guard_size[((char *)ptr - guard_base) >> (PAGE_SHIFT + 1)];
+#endif
+    if (IS_SLAB(ptr))
+	return SLAB_SIZE(((slab_t *)SLAB_RUN(ptr))->cls);
+    if (GET_MMAPPED(HDRP(ptr)))
+	return GET_SIZE(HDRP(ptr)) - MMAP_OFFSET(ptr);
+    return GET_SHARED_SIZE(HDRP(ptr)) - WSIZE;
 }
 
-/* extend_heap - extends the heap */
-static void *extend_heap (size_t words)
+/* mm_region_create - a region whose chunks are chunk_size bytes (REGION_CHUNK for 0), NULL if out of memory */
+struct mm_region *mm_region_create(size_t chunk_size)
 {
-    char *bp;
-    size_t size;
-    
-    /* allocate an even number of words to maintain alignment */
-    size = (words %2) ? (words +1) * WSIZE : words * WSIZE;
-    if ((long)(bp = mem_sbrk(size)) == -1)
-	{return NULL;}
-    /*Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0)); /*free block header*/
-    PUT(FTRP(bp), PACK(size, 0)); /*free block footer*/
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1)); /*epilogue header*/
+    struct mm_region *r;
 
-    /* Coalesce if the previous block was free*/
-    return coalesce(bp);
+    if (chunk_size == 0)
+	chunk_size = REGION_CHUNK;
+    chunk_size = MAX(ALIGN(chunk_size), ALIGN(sizeof(*r)) + DSIZE);
+    if ((r = mm_malloc(chunk_size)) == NULL)
+	return NULL;
+    r->chunks = NULL;
+    r->chunk_size = chunk_size;
+    r->cur = (char *)r + ALIGN(sizeof(*r));
+    r->end = (char *)r + chunk_size;
+    return r;
 }
 
-/* 
- * mm_init - initialize the malloc package.
- */
-int mm_init(void)
+/* region_chunk - a new chunk of size bytes on the list of r, return its first usable byte */
+static char *region_chunk(struct mm_region *r, size_t size)
 {
-//initialize an unused block to satisfy the alignment requirement
-    /*CREATE THE INITIAL EMPTY HEAP*/
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
-	return -1;
-    PUT(heap_listp, 0);  /*First word unused for alignment*/
-    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /*Prologue header*/
-    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /*Prologue footer*/
-    PUT(heap_listp + (3*WSIZE), PACK(0, 1)); /*Epilogue header*/
-    
+    char *c;
 
-    heap_listp+=(2*WSIZE);
-    
-    previous = heap_listp;
-/* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
-	return -1;
-    return 0;
+    if (size > MAX_REQUEST - REGION_LINK || (c = mm_malloc(REGION_LINK + size)) == NULL)
+	return NULL;
+    *(char **)c = r->chunks;
+    r->chunks = c;
+    return c + REGION_LINK;
 }
 
 /*
- * mm_findfit - Search the implicit free list for a first fit
- * if no fit can be found (i.e.the end of heap is reached without a fit), return -1
+ * mm_region_alloc - size bytes from region r, aligned like mm_malloc; NULL for 0 bytes or
+ * when out of memory.  Blocks are never freed on their own, only by a reset of the region.
  */
-static void *find_fit(size_t asize)
+void *mm_region_alloc(struct mm_region *r, size_t size)
 {
-   /*first-fit search*/
-   void *bp;
-   
-   for (bp = previous; GET_SIZE(HDRP(bp))>0; bp = NEXT_BLKP(bp))
-   {
-	if (!GET_ALLOC(HDRP(bp)) && (asize<=GET_SIZE(HDRP(bp))))
-	{
-		previous = NEXT_BLKP(bp);
-		return bp;
-        }
-   }
-/*wrap around when next_fit pointer reaches the end of the heap*/
-   for (bp = heap_listp; GET_SIZE(HDRP(bp))>0; bp = NEXT_BLKP(bp))
-   {
-        if (!GET_ALLOC(HDRP(bp)) && (asize<=GET_SIZE(HDRP(bp))))
-        {
-                previous = NEXT_BLKP(bp);
-                return bp;
-        }
-   }
-   return NULL;
+    char *bp;
 
+    if (size == 0 || size > MAX_REQUEST)
+	return NULL;
+    size = ALIGN(size);
+    if (size <= (size_t)(r->end - r->cur))
+    {
+	bp = r->cur;
+	r->cur += size;
+	return bp;
+    }
+/*a quarter chunk or more gets a chunk of its own, so the current one keeps its space*/
+    if (size >= r->chunk_size / 4)
+	return region_chunk(r, size);
+    if ((bp = region_chunk(r, r->chunk_size - REGION_LINK)) == NULL)
+	return NULL;
+    r->cur = bp + size;
+    r->end = bp + r->chunk_size - REGION_LINK;
+    return bp;
 }
 
-static void place (void *bp, size_t asize)
+/* mm_region_reset - free everything allocated from r at once, keeping its first chunk for reuse */
+void mm_region_reset(struct mm_region *r)
 {
-    size_t csize = GET_SIZE(HDRP(bp));
-/*to split the blocks if the size is greater than what is required*/    
-    if ((csize - asize)>=(2*DSIZE))
+    char *c;
+
+    while ((c = r->chunks) != NULL)
     {
-	PUT(HDRP(bp), PACK(asize,1));
-	PUT(FTRP(bp), PACK(asize,1));
-	bp = NEXT_BLKP(bp);
-	PUT(HDRP(bp), PACK(csize-asize,0));
-	PUT(FTRP(bp), PACK(csize-asize,0));
+	r->chunks = *(char **)c;
+	mm_free(c);
     }
+    r->cur = (char *)r + ALIGN(sizeof(*r));
+    r->end = (char *)r + r->chunk_size;
+}
 
-    else
+/* mm_region_destroy - free r and everything allocated from it */
+void mm_region_destroy(struct mm_region *r)
+{
+    if (r == NULL)
+	return;
+    mm_region_reset(r);
+    mm_free(r);
+}
+
+/* handle_new - the index of an unused table entry, growing the table if need be; (size_t)-1 if out of memory; the caller holds handle_lock */
+static size_t handle_new(void)
+{
+    handle_t *t;
+    size_t i, cap;
+
+    if (handle_free != 0)
+    {
+	i = handle_free - 1;
+	handle_free = handles[i].next;
+	return i;
+    }
+    if (handle_count == handle_cap)
     {
-	PUT(HDRP(bp), PACK(csize,1));
-	PUT(FTRP(bp), PACK(csize,1));
+	cap = handle_cap == 0 ? HANDLE_CHUNK : 2 * handle_cap;
+	t = handles == NULL ? mmap(NULL, cap * sizeof(handle_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) :
+	    mremap(handles, handle_cap * sizeof(handle_t), cap * sizeof(handle_t), MREMAP_MAYMOVE);
+	if (t == MAP_FAILED)
+	    return (size_t)-1;
+	handles = t;
+	handle_cap = cap;
     }
+    return handle_count++;
 }
 
-/* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+/*
+ * mm_halloc - allocate size bytes reached through a handle, so that mm_compact may move them
+ * while they are not pinned; return the handle, 0 if out of memory.  The block always comes from
+ * the heap proper: no slab, thread cache or mapping of its own, which could not be moved.
  */
-void *mm_malloc(size_t size)
+mm_handle_t mm_halloc(size_t size)
 {
-    size_t asize; /*adjusted block size*/
-    size_t extendsize; /*amount to extend heap if no fit */
+    arena_t *a;
     char *bp;
-    
-    /*ignore spurious requests*/
-    if (size == 0)
-	return NULL;
+    size_t i;
 
-    /*ADJUST BLOCK SIZE TO INCLUDE OVERHEAD AND ALIGNMENT REQS. */
-    if (size <= DSIZE)
-	asize = 2*DSIZE;
-    else
-	asize = DSIZE * ((size + (DSIZE)+ (DSIZE-1))/DSIZE);
+    if (size == 0 || size > MAX_REQUEST - HANDLE_HDR)
+	return 0;
+#if MM_THREADS
+    if ((a = thread_arena_get()) == NULL)
+	return 0;
+#else
+    a = &arenas[0];
+#endif
+    arena_lock(a);
+    bp = arena_malloc(a, adjust_size(size + HANDLE_HDR));
+    UNLOCK(&a->lock);
+    if (bp == NULL)
+	return 0;
+    LOCK(&handle_lock);
+    if ((i = handle_new()) == (size_t)-1)
+    {
+	UNLOCK(&handle_lock);
+	free_to_arena(bp);
+	return 0;
+    }
+    PUT(bp, (word_t)i);
+    handles[i].bp = bp;
+    handles[i].pins = 0;
+    UNLOCK(&handle_lock);
+    return i + 1;
+}
+
+/* mm_hpin - the payload of handle h, which stays put until the matching mm_hunpin; NULL for a handle not allocated */
+void *mm_hpin(mm_handle_t h)
+{
+    char *bp = NULL;
+
+    LOCK(&handle_lock);
+    if (h != 0 && h <= handle_count && (bp = handles[h - 1].bp) != NULL)
+	handles[h - 1].pins++;
+    UNLOCK(&handle_lock);
+    return bp == NULL ? NULL : bp + HANDLE_HDR;
+}
+
+/* mm_hunpin - drop a pin of handle h; pointers from mm_hpin may be stale once the last one goes */
+void mm_hunpin(mm_handle_t h)
+{
+    LOCK(&handle_lock);
+    if (h != 0 && h <= handle_count && handles[h - 1].bp != NULL && handles[h - 1].pins > 0)
+	handles[h - 1].pins--;
+    UNLOCK(&handle_lock);
+}
+
+/* mm_hfree - free the block of handle h, pinned or not, and the handle with it */
+void mm_hfree(mm_handle_t h)
+{
+    char *bp;
 
-    /*Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL)
+    LOCK(&handle_lock);
+    if (h == 0 || h > handle_count || (bp = handles[h - 1].bp) == NULL)
     {
-	place(bp,asize);
-	return bp;
+	UNLOCK(&handle_lock);
+	return;
     }
+/*once the entry is free the compactor no longer takes the block for a handle block*/
+    handles[h - 1].bp = NULL;
+    handles[h - 1].next = handle_free;
+    handle_free = h;
+    UNLOCK(&handle_lock);
+    free_to_arena(bp);
+}
 
-    /*no fit found get more memory and place the block*/
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-	return NULL;
-    place(bp, asize);
-    return bp;
+/*
+ * compact_slide - move the handle block after free block fb of arena a down into it, unless the
+ * block is pinned or no handle block, and free the space left behind it, merged with whatever
+ * free block follows; return the bytes moved.  The caller holds the lock of a.
+ */
+static size_t compact_slide(arena_t *a, char *fb)
+{
+    char *hb = NEXT_BLKP(fb);
+    size_t fsize = GET_SIZE(HDRP(fb)), hsize = GET_SIZE(HDRP(hb)), i;
+
+    if (hsize == 0 || !GET_ALLOC(HDRP(hb)))
+	return 0;
+    LOCK(&handle_lock);
+    i = GET(hb);
+    if (i >= handle_count || handles[i].bp != hb || handles[i].pins != 0)
+    {
+	UNLOCK(&handle_lock);
+	return 0;
+    }
+    remove_free_block(a, fb);
+/*the payload runs up to the next header, footer word included; fb has an allocated predecessor as every free block*/
+    memmove(fb, hb, hsize - WSIZE);
+    PUT(HDRP(fb), PACK(hsize, PREV_ALLOC | 1));
+    PUT(HDRP(fb + hsize), PACK(fsize, PREV_ALLOC | 1));
+    handles[i].bp = fb;
+    UNLOCK(&handle_lock);
+    CHECK_MERGED(a, hb, fb);
+    arena_free(a, fb + hsize);
+    return hsize;
 }
 
+/*
+ * mm_compact - slide unpinned handle blocks down into the free blocks before them, segment by
+ * segment from the bottom of the heap, until max_bytes have moved (0 for no limit), so that the
+ * free space of each segment gathers at its top; then give the pages of that top block back.
+ * Other blocks and pinned handles stay where they are.  Return the bytes moved.
+ */
+size_t mm_compact(size_t max_bytes)
+{
+    arena_t *a;
+    char *seg, *bp, *end;
+    size_t moved = 0, n, seg_moved;
+
+    if (heap_base == NULL || arenas[0].heap_listp == NULL)
+	return 0;
+    if (max_bytes == 0)
+	max_bytes = (size_t)-1;
+    LOCK(&heap_lock);
+    end = heap_brk;
+    UNLOCK(&heap_lock);
+/*each segment is walked under the lock of its arena, and ends at its epilogue, where the next one starts*/
+    for (seg = heap_base; seg < end && moved < max_bytes; seg = bp)
+    {
+	a = &arenas[GET(seg)];
+	arena_lock(a);
+	seg_moved = 0;
+	for (bp = seg + SEG_OVERHEAD; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+	    if (!GET_ALLOC(HDRP(bp)))
+		while (moved < max_bytes && (n = compact_slide(a, bp)) > 0)
+		{
+		    moved += n;
+		    seg_moved += n;
+		    bp += n;
+		}
+	if (seg_moved > 0 && !GET_PREV_ALLOC(HDRP(bp)))
+	    release_pages(PREV_BLKP(bp), 0);
+	UNLOCK(&a->lock);
+    }
+    return moved;
+}
 
 /*
- * mm_free - Freeing a block changes the alloctated bit to status 0
+ * copy_block - copy n bytes of payload for a moving realloc: memcpy for the sizes that fit in
+ * the cache, non-temporal stores from COPY_NT_MIN on, so that the destination does not evict it
  */
-void mm_free(void *ptr)
+static void copy_block(char *dst, const char *src, size_t n)
+{
+#ifdef __SSE2__
+    size_t head;
+
+    if (n >= COPY_NT_MIN)
+    {
+/*payloads are only ALIGNMENT aligned, streaming stores need 16 bytes*/
+	head = (16 - ((uintptr_t)dst & 15)) & 15;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+	for (; n >= 64; n -= 64, dst += 64, src += 64)
+	{
+	    __m128i x0 = _mm_loadu_si128((const __m128i *)src);
+	    __m128i x1 = _mm_loadu_si128((const __m128i *)(src + 16));
+	    __m128i x2 = _mm_loadu_si128((const __m128i *)(src + 32));
+	    __m128i x3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+	    _mm_stream_si128((__m128i *)dst, x0);
+	    _mm_stream_si128((__m128i *)(dst + 16), x1);
+	    _mm_stream_si128((__m128i *)(dst + 32), x2);
+	    _mm_stream_si128((__m128i *)(dst + 48), x3);
+	}
+/*streaming stores are weakly ordered, later stores to the block must not pass them*/
+	_mm_sfence();
+    }
+#endif
+    memcpy(dst, src, n);
+}
+
+/*
+ * realloc_in_place - resize oldptr to newsize bytes using the heap around it: in place when it
+ * shrinks or when the free block or the end of the arena that follows it is enough, otherwise
+ * by sliding the contents down into a free predecessor, taking want bytes (at least newsize)
+ * there if they fit.  The caller holds the arena lock.  Return the block, NULL if it has to be copied.
+ */
+static void *realloc_in_place(arena_t *a, void *oldptr, size_t newsize, size_t want)
 {
-    size_t size = GET_SIZE(HDRP(ptr));
-    PUT(HDRP(ptr),PACK(size,0));
-    PUT(FTRP(ptr),PACK(size,0));
-    coalesce(ptr);
+    size_t oldSize = GET_SIZE(HDRP(oldptr));
+    size_t totalSize = oldSize + GET_SIZE(HDRP(NEXT_BLKP(oldptr)));
+    size_t prevSize;
+    char *bp;
+
+/*if the block shrinks, split off the tail and free it, merging it with a free successor*/
+    if (newsize <= oldSize)
+    {
+	if (oldSize - newsize >= 2*DSIZE)
+	{
+	    PUT(HDRP(oldptr), PACK(newsize, 1 | GET_PREV_ALLOC(HDRP(oldptr))));
+	    bp = NEXT_BLKP(oldptr);
+	    PUT(HDRP(bp), PACK(oldSize - newsize, 1 | PREV_ALLOC));
+	    arena_free(a, bp);
+	}
+	STAT_ADD(realloc_shrink, 1);
+	return oldptr;
+    }
+/*if the next block is free and size is enough*/
+    if (!GET_ALLOC(HDRP(NEXT_BLKP(oldptr))) && (newsize <= totalSize))
+    {
+	CHECK_MERGED(a, NEXT_BLKP(oldptr), oldptr);
+	remove_free_block(a, NEXT_BLKP(oldptr));
+	PUT(HDRP(oldptr), PACK(totalSize, 1 | GET_PREV_ALLOC(HDRP(oldptr))));
+	place(a, oldptr, newsize);
+	STAT_ADD(realloc_in_place, 1);
+	return oldptr;
+    }
+/*if the previous block is free and, with the next one when it is free too, big enough: move the contents down*/
+    if (!GET_PREV_ALLOC(HDRP(oldptr)))
+    {
+	bp = PREV_BLKP(oldptr);
+	prevSize = GET_SIZE(HDRP(bp)) + (GET_ALLOC(HDRP(NEXT_BLKP(oldptr))) ? oldSize : totalSize);
+	if (newsize <= prevSize)
+	{
+	    CHECK_MERGED(a, oldptr, bp);
+	    if (!GET_ALLOC(HDRP(NEXT_BLKP(oldptr))))
+	    {
+		CHECK_MERGED(a, NEXT_BLKP(oldptr), bp);
+		remove_free_block(a, NEXT_BLKP(oldptr));
+	    }
+	    remove_free_block(a, bp);
+	    PUT(HDRP(bp), PACK(prevSize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+	    memmove(bp, oldptr, oldSize - WSIZE);
+	    place(a, bp, want <= prevSize ? want : newsize);
+	    STAT_ADD(realloc_move_back, 1);
+	    return bp;
+	}
+    }
+/*if the next block is free and size is not enough but it's the epilogue block*/
+    if (!GET_ALLOC(HDRP(NEXT_BLKP(oldptr))) && (newsize > totalSize) && HDRP(NEXT_BLKP(NEXT_BLKP(oldptr))) == a->epilogue)
+    {
+	size_t adding = (newsize - totalSize)/WSIZE;
+	void * addedBlock = extend_heap(a, adding);
+/*the extension may have gone to a new segment if another arena took the break*/
+	if (addedBlock != NEXT_BLKP(oldptr))
+	    return NULL;
+	CHECK_MERGED(a, addedBlock, oldptr);
+	remove_free_block(a, addedBlock);
+	PUT(HDRP(oldptr), PACK(GET_SIZE(HDRP(oldptr)) + GET_SIZE(HDRP(addedBlock)), 1 | GET_PREV_ALLOC(HDRP(oldptr))));
+	place(a, oldptr, newsize);
+	STAT_ADD(realloc_extend, 1);
+	return oldptr;
+    }
+/*if the next block is the epilogue block and the block has to grow*/
+    if (HDRP(NEXT_BLKP(oldptr)) == a->epilogue)
+    {
+	size_t adding = (newsize - GET_SIZE(HDRP(oldptr)))/WSIZE;
+	void * addedBlock = extend_heap(a, adding);
+	if (addedBlock != NEXT_BLKP(oldptr))
+	    return NULL;
+	CHECK_MERGED(a, addedBlock, oldptr);
+	remove_free_block(a, addedBlock);
+        PUT(HDRP(oldptr), PACK(GET_SIZE(HDRP(oldptr)) + GET_SIZE(HDRP(addedBlock)), 1 | GET_PREV_ALLOC(HDRP(oldptr))));
+	place(a, oldptr, newsize);
+	STAT_ADD(realloc_extend, 1);
+        return oldptr;
+    }
+    return NULL;
 }
 
 /*
@@ -292,68 +4284,96 @@ void mm_free(void *ptr)
  */
 void *mm_realloc(void *ptr, size_t size)
 {
+  void *newptr;
+#if MM_STATS
+  size_t old_bytes = ptr != NULL ? block_bytes(ptr) : 0;
+#endif
+
+/*a realloc drops the sample of the old block before another thread can get its address, and counts its new size as allocated; a failed one loses the sample*/
+  if (ptr != NULL)
+    PROF_FREE(ptr);
+  newptr = realloc_block(ptr, size);
+  STAT_ADD(reallocs, 1);
+#if MM_STATS
+  if (newptr != NULL)
+    STAT_ADD(live_bytes, (newptr == (void *)-1 ? 0 : block_bytes(newptr)) - old_bytes);
+#endif
+  if (newptr != NULL)
+    TRACE(MM_TRACE_REALLOC, size, newptr == (void *)-1 ? NULL : newptr, ptr);
+  if (newptr != (void *)-1)
+    PROF_MALLOC(newptr, size);
+  return newptr;
+}
 
+/* realloc_block - the work of mm_realloc */
+static void *realloc_block(void *ptr, size_t size)
+{
   if (ptr == NULL)
-    return mm_malloc(size);
+    return malloc_block(size);
   else if (size == 0)
   {
-    mm_free(ptr);
+    free_block(ptr);
     return (void *)-1;
   }
+  else if (size > MAX_REQUEST)
+    return NULL;
   else
   {
-    size_t newsize = ALIGN(size + SIZE_T_SIZE*2);
+    size_t newsize = adjust_size(size);
+    size_t grow = size; /*bytes to ask for if the block moves*/
     void *oldptr = ptr;
     void *newptr;
-    int copySize;
-    int totalSize = GET_SIZE(HDRP(oldptr)) + GET_SIZE(HDRP(NEXT_BLKP(oldptr)));
-/*if the next block is free and size is enough*/
-    if (!GET_ALLOC(HDRP(NEXT_BLKP(oldptr))) && (newsize <= totalSize))
-    { 
-	PUT(HDRP(oldptr), PACK(totalSize, 1));
-	PUT(FTRP(oldptr), PACK(totalSize, 1));
-	place(oldptr, newsize);
-	return oldptr;	
-    }
-/*if the next block is free and size is not enough but it's the epilogue block*/
-    else if (!GET_ALLOC(HDRP(NEXT_BLKP(oldptr))) && (newsize > totalSize) && GET_SIZE(HDRP(NEXT_BLKP(NEXT_BLKP(oldptr))))==0)
-    {
-	int newWords = newsize/WSIZE;
-	int totalWords = totalSize/WSIZE;
-	int adding = newWords - totalWords;
-	void * addedBlock = extend_heap(adding);
-	int addedSize = GET_SIZE(HDRP(addedBlock));
-	int totalSize1 = GET_SIZE(HDRP(oldptr)) + addedSize;
-	PUT(HDRP(oldptr), PACK(totalSize1, 1));
-        PUT(FTRP(oldptr), PACK(totalSize1, 1));
-	return oldptr;
-    }
-/*if the next block is the epilogue block*/
-    else if (GET_SIZE(HDRP(NEXT_BLKP(oldptr)))==0)
-    {
-	int newWords = newsize/WSIZE;
-	int oldWords = (GET_SIZE(HDRP(oldptr)))/WSIZE;
-	int adding = newWords - oldWords;
-	void * addedBlock = extend_heap(adding);
-        int addedSize = GET_SIZE(HDRP(addedBlock));
-        int totalSize1 = GET_SIZE(HDRP(oldptr)) + addedSize;
-        PUT(HDRP(oldptr), PACK(totalSize1, 1));
-        PUT(FTRP(oldptr), PACK(totalSize1, 1));
+    size_t copySize;
+    arena_t *a;
+
+#if MM_GUARD
+    if (IN_GUARD(oldptr))
+      return guard_realloc(oldptr, size);
+#endif
+/*a slab object can only stay where it is if its class still holds size bytes*/
+    if (IS_SLAB(oldptr))
+    {
+      copySize = SLAB_SIZE(((slab_t *)SLAB_RUN(oldptr))->cls);
+      if (size <= copySize)
+      {
+        STAT_ADD(realloc_in_place, 1);
         return oldptr;
+      }
+      grow = REALLOC_GROW(copySize, size);
+    }
+/*a mapped block stays mapped while it is above the threshold, or too large to be worth copying, and the kernel moves its pages*/
+    else if (GET_MMAPPED(HDRP(oldptr)))
+    {
+      if ((size >= mmap_threshold || size >= COPY_NT_MIN) && (newptr = mmap_realloc(oldptr, size)) != NULL)
+      {
+        STAT_ADD(realloc_mremap, 1);
+        return newptr;
+      }
+      copySize = GET_SIZE(HDRP(oldptr)) - MMAP_OFFSET(oldptr);
     }
     else
     {
-    newptr = mm_malloc(newsize);
-    if (newptr == NULL)
+      a = block_arena(oldptr);
+      copySize = GET_SHARED_SIZE(HDRP(oldptr)) - WSIZE;
+      grow = REALLOC_GROW(copySize, size);
+      LOCK(&a->lock);
+      PERSIST_DIRTY();
+      newptr = realloc_in_place(a, oldptr, newsize, adjust_size(grow));
+      UNLOCK(&a->lock);
+      if (newptr != NULL)
+        return newptr;
+    }
+
+/*the room for further growth is only worth having if it can be found*/
+    if ((newptr = malloc_block(grow)) == NULL && (grow == size || (newptr = malloc_block(size)) == NULL))
       return NULL;
 
-    copySize = (*(int *)((char *)oldptr - SIZE_T_SIZE))-(2*SIZE_T_SIZE +1);
     if (size < copySize)
       copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
+    copy_block(newptr, oldptr, copySize);
+    free_block(oldptr);
+    STAT_ADD(realloc_copy, 1);
     return newptr;
-    }
   }
 }
 
@@ -381,5 +4401,6 @@ void *mm_realloc(void *ptr, size_t size)
 
 
 
+
 
 
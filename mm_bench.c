@@ -0,0 +1,787 @@
+/*
+ * mm_bench.c - trace-driven benchmark for the allocator in mm.c
+ *
+ * Replays allocation traces against mm_malloc/mm_free/mm_realloc and reports throughput,
+ * peak utilization and per-operation latency percentiles.  Traces come from files or from
+ * synthetic generators of common production patterns:
+ *
+ *   mm_bench [-r reps] [-p policy] [-M] [-v] [-c] [-n ops] [-s seed] [-o out] [-g gen]... [trace]...
+ *
+ *   -r reps    replay every trace reps times on a fresh heap, reporting the last run
+ *   -p policy  placement policy: first, next, best or aobf (see mm_ext.h)
+ *   -M         keep huge blocks in the heap (no mmap path), so utilization covers them
+ *   -v         fill every block and check its contents on realloc and free (slow), and that
+ *              every block and small mm_memalign(BENCH_ALIGN, n) is BENCH_ALIGN aligned
+ *   -c         report latencies in TSC cycles rather than nanoseconds (x86), for worst-case bounds
+ *   -n ops     operations per generated trace (default 100000)
+ *   -s seed    seed of the generators (default 1)
+ *   -o out     write the last generated trace to out, in the text format below
+ *   -g gen     add a generated trace: small, prodcons, vector or powerlaw
+ *              (-n, -s and -o apply to the -g options that follow them)
+ *
+ * A trace file holds one operation per line, the malloc-lab format:
+ *   a <id> <size>     id = mm_malloc(size)
+ *   r <id> <size>     id = mm_realloc(id, size)
+ *   f <id>            mm_free(id)
+ * Lines starting with anything else (such as the malloc-lab header numbers) are ignored.
+ * Files written by mm_trace_start (see mm_ext.h) are read as well: their records are
+ * replayed in timestamp order from a single thread, block addresses becoming ids.
+ *
+ * Throughput counts only the time spent inside the allocator.  Utilization is the peak of the
+ * live payload in the heap over the heap size, mem_heap_hi - mem_heap_lo + 1, at the end of the
+ * run; blocks outside the heap, which got a mapping of their own, count in neither (see -M).
+ *
+ * Build it against the memlib.c of the malloc lab, with the same -D options as mm.c:
+ *   gcc -O2 -o mm_bench mm_bench.c mm.c memlib.c -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mm.h"
+#include "mm_ext.h"
+#include "memlib.h"
+
+#define DEFAULT_OPS 100000
+
+/* One operation of a trace */
+typedef struct op {
+    char type;          /*'a', 'r' or 'f'*/
+    unsigned int id;
+    size_t size;
+} op_t;
+
+typedef struct trace {
+    char name[64];
+    op_t *ops;
+    size_t nops, cap;
+    unsigned int nids;  /*ids run from 0 to nids-1*/
+} trace_t;
+
+/* What one replay measured */
+typedef struct result {
+    double secs;        /*time inside the allocator*/
+    double util;        /*peak live payload in the heap over the final heap size*/
+    unsigned long *lat; /*nanoseconds (or cycles, with -c) of every operation*/
+    int failed;
+} result_t;
+
+/*payload alignment mm.c promises, see ALIGNMENT there*/
+#if MM_64BIT
+#define BENCH_ALIGN 16
+#else
+#define BENCH_ALIGN 8
+#endif
+
+static int verify;
+static int cycles;
+
+/* add_op - append an operation to trace t */
+static void add_op(trace_t *t, char type, unsigned int id, size_t size)
+{
+    if (t->nops == t->cap)
+    {
+        t->cap = t->cap ? 2 * t->cap : 1024;
+        if ((t->ops = realloc(t->ops, t->cap * sizeof(op_t))) == NULL)
+        {
+            fprintf(stderr, "mm_bench: out of memory\n");
+            exit(1);
+        }
+    }
+    t->ops[t->nops].type = type;
+    t->ops[t->nops].id = id;
+    t->ops[t->nops].size = size;
+    t->nops++;
+    if (id >= t->nids)
+        t->nids = id + 1;
+}
+
+/*
+ * Address map of recorded traces: open addressing with linear probing from block address to
+ * trace id; freed ids are recycled so that ids stay dense.
+ */
+typedef struct addr_map {
+    uint64_t *key;      /*0 marks an empty slot*/
+    unsigned int *id;
+    size_t cap, n;
+    unsigned int *free_ids, nfree, free_cap, next_id;
+} addr_map_t;
+
+static size_t map_home(addr_map_t *m, uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key & (m->cap - 1);
+}
+
+static size_t map_slot(addr_map_t *m, uint64_t key)
+{
+    size_t i = map_home(m, key);
+
+    while (m->key[i] != 0 && m->key[i] != key)
+        i = (i + 1) & (m->cap - 1);
+    return i;
+}
+
+static void map_grow(addr_map_t *m)
+{
+    addr_map_t old = *m;
+    size_t i, j;
+
+    m->cap = old.cap ? 2 * old.cap : 1024;
+    m->key = calloc(m->cap, sizeof(uint64_t));
+    m->id = calloc(m->cap, sizeof(unsigned int));
+    if (m->key == NULL || m->id == NULL)
+    {
+        fprintf(stderr, "mm_bench: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < old.cap; i++)
+        if (old.key[i] != 0)
+        {
+            j = map_slot(m, old.key[i]);
+            m->key[j] = old.key[i];
+            m->id[j] = old.id[i];
+        }
+    free(old.key);
+    free(old.id);
+}
+
+/* map_find - id of the block at key, -1 if the trace never allocated it */
+static long map_find(addr_map_t *m, uint64_t key)
+{
+    size_t i;
+
+    if (m->cap == 0)
+        return -1;
+    i = map_slot(m, key);
+    return m->key[i] == key ? (long)m->id[i] : -1;
+}
+
+/* map_add - give the block at key an id (its old id if it is passed one), return it */
+static unsigned int map_add(addr_map_t *m, uint64_t key, long id)
+{
+    size_t i;
+
+    if (2 * (m->n + 1) > m->cap)
+        map_grow(m);
+    if (id < 0)
+        id = m->nfree > 0 ? m->free_ids[--m->nfree] : m->next_id++;
+    i = map_slot(m, key);
+    if (m->key[i] == 0)
+        m->n++;
+    m->key[i] = key;
+    m->id[i] = id;
+    return id;
+}
+
+/* map_del - forget the block at key, recycling its id unless keep_id is set */
+static void map_del(addr_map_t *m, uint64_t key, int keep_id)
+{
+    size_t i = map_slot(m, key), j, k;
+
+    if (m->key[i] == 0)
+        return;
+    if (!keep_id)
+    {
+        if (m->nfree == m->free_cap)
+        {
+            m->free_cap = m->free_cap ? 2 * m->free_cap : 1024;
+            m->free_ids = realloc(m->free_ids, m->free_cap * sizeof(unsigned int));
+        }
+        m->free_ids[m->nfree++] = m->id[i];
+    }
+    /*backward-shift deletion keeps every probe sequence unbroken*/
+    m->key[i] = 0;
+    m->n--;
+    for (j = (i + 1) & (m->cap - 1); m->key[j] != 0; j = (j + 1) & (m->cap - 1))
+    {
+        k = map_home(m, m->key[j]);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+        {
+            m->key[i] = m->key[j];
+            m->id[i] = m->id[j];
+            m->key[j] = 0;
+            i = j;
+        }
+    }
+}
+
+static int cmp_rec(const void *x, const void *y)
+{
+    const struct mm_trace_rec *a = x, *b = y;
+
+    if (a->ts != b->ts)
+        return a->ts < b->ts ? -1 : 1;
+    if (a->tid != b->tid)
+        return a->tid < b->tid ? -1 : 1;
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * load_recorded - read the records of an mm_trace_start file f into trace t.  Frees of blocks
+ * allocated before recording began are dropped, as are the allocations that precede them.
+ */
+static int load_recorded(trace_t *t, FILE *f, const char *path)
+{
+    struct mm_trace_hdr hdr;
+    struct mm_trace_rec *recs = NULL;
+    size_t n = 0, cap = 0, i;
+    addr_map_t m;
+    long id;
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.version != MM_TRACE_VERSION
+        || hdr.rec_size != sizeof(struct mm_trace_rec))
+    {
+        fprintf(stderr, "%s: not a trace of this version\n", path);
+        return -1;
+    }
+    for (;;)
+    {
+        if (n == cap)
+        {
+            cap = cap ? 2 * cap : 65536;
+            if ((recs = realloc(recs, cap * sizeof(*recs))) == NULL)
+            {
+                fprintf(stderr, "mm_bench: out of memory\n");
+                exit(1);
+            }
+        }
+        if (fread(&recs[n], sizeof(*recs), 1, f) != 1)
+            break;
+        n++;
+    }
+    /*records within a ring are already in order: sorting by time, then thread, keeps that order*/
+    qsort(recs, n, sizeof(*recs), cmp_rec);
+
+    memset(&m, 0, sizeof(m));
+    for (i = 0; i < n; i++)
+    {
+        struct mm_trace_rec *r = &recs[i];
+
+        switch (r->op)
+        {
+        case MM_TRACE_MALLOC:
+            add_op(t, 'a', map_add(&m, r->ptr, -1), r->size);
+            break;
+        case MM_TRACE_FREE:
+            if ((id = map_find(&m, r->ptr)) >= 0)
+            {
+                map_del(&m, r->ptr, 0);
+                add_op(t, 'f', id, 0);
+            }
+            break;
+        case MM_TRACE_REALLOC:
+            id = r->old ? map_find(&m, r->old) : -1;
+            if (id >= 0 && r->ptr == 0)
+            {
+                map_del(&m, r->old, 0);
+                add_op(t, 'f', id, 0);
+            }
+            else if (id >= 0)
+            {
+                map_del(&m, r->old, 1);
+                add_op(t, 'r', map_add(&m, r->ptr, id), r->size);
+            }
+            else if (r->ptr != 0)
+                add_op(t, 'a', map_add(&m, r->ptr, -1), r->size);
+            break;
+        }
+    }
+    free(recs);
+    free(m.key);
+    free(m.id);
+    free(m.free_ids);
+    return 0;
+}
+
+/* load_trace - read a trace file, text or recorded by mm_trace_start, return 0 on success */
+static int load_trace(trace_t *t, const char *path)
+{
+    FILE *f;
+    char line[256], type;
+    unsigned int id;
+    unsigned long size;
+    const char *base = strrchr(path, '/');
+    int rc;
+
+    if ((f = fopen(path, "r")) == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    snprintf(t->name, sizeof(t->name), "%s", base ? base + 1 : path);
+    if (fread(line, 1, sizeof(MM_TRACE_MAGIC), f) == sizeof(MM_TRACE_MAGIC)
+        && memcmp(line, MM_TRACE_MAGIC, sizeof(MM_TRACE_MAGIC)) == 0)
+    {
+        rewind(f);
+        rc = load_recorded(t, f, path);
+        fclose(f);
+        return rc;
+    }
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        size = 0;
+        if (sscanf(line, " %c %u %lu", &type, &id, &size) < 2)
+            continue;
+        if (type == 'a' || type == 'r' || type == 'f')
+            add_op(t, type, id, size);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* save_trace - write trace t to path in the text format */
+static int save_trace(trace_t *t, const char *path)
+{
+    FILE *f;
+    size_t i;
+
+    if ((f = fopen(path, "w")) == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    for (i = 0; i < t->nops; i++)
+    {
+        if (t->ops[i].type == 'f')
+            fprintf(f, "f %u\n", t->ops[i].id);
+        else
+            fprintf(f, "%c %u %zu\n", t->ops[i].type, t->ops[i].id, t->ops[i].size);
+    }
+    return fclose(f);
+}
+
+/*
+ * Generators.  They keep the set of live ids in live[0..nlive) and recycle freed ids through
+ * a stack, so that a trace needs no more ids than it ever has live blocks.
+ */
+typedef struct gen {
+    trace_t *t;
+    unsigned int *live, nlive;
+    size_t *size;           /*current size of every id*/
+    unsigned int *ids, nfree;
+} gen_t;
+
+static void gen_start(gen_t *g, trace_t *t, size_t max_live)
+{
+    g->t = t;
+    g->live = calloc(max_live, sizeof(unsigned int));
+    g->size = calloc(max_live, sizeof(size_t));
+    g->ids = calloc(max_live, sizeof(unsigned int));
+    g->nlive = 0;
+    for (g->nfree = 0; g->nfree < max_live; g->nfree++)
+        g->ids[g->nfree] = max_live - 1 - g->nfree;
+}
+
+/* gen_alloc - allocate size bytes to a new id, return its slot in live[] */
+static unsigned int gen_alloc(gen_t *g, size_t size)
+{
+    unsigned int id = g->ids[--g->nfree];
+
+    add_op(g->t, 'a', id, size);
+    g->size[id] = size;
+    g->live[g->nlive] = id;
+    return g->nlive++;
+}
+
+/* gen_free - free the block in slot i of live[] */
+static void gen_free(gen_t *g, unsigned int i)
+{
+    unsigned int id = g->live[i];
+
+    add_op(g->t, 'f', id, 0);
+    g->ids[g->nfree++] = id;
+    g->live[i] = g->live[--g->nlive];
+}
+
+/* gen_end - free everything still live, so every trace ends with an empty heap */
+static void gen_end(gen_t *g)
+{
+    while (g->nlive > 0)
+        gen_free(g, g->nlive - 1);
+    free(g->live);
+    free(g->size);
+    free(g->ids);
+}
+
+/* uniform - random integer in [lo, hi] */
+static size_t uniform(size_t lo, size_t hi)
+{
+    return lo + (size_t)((double)rand() / ((double)RAND_MAX + 1) * (hi - lo + 1));
+}
+
+/* gen_small - many small objects with random lifetimes, the load of a linked data structure */
+static void gen_small(trace_t *t, size_t n)
+{
+    gen_t g;
+
+    gen_start(&g, t, 20000);
+    while (t->nops < n)
+    {
+        if (g.nfree > 0 && (g.nlive == 0 || rand() % 2))
+            gen_alloc(&g, uniform(8, 128));
+        else
+            gen_free(&g, uniform(0, g.nlive - 1));
+    }
+    gen_end(&g);
+}
+
+/* gen_prodcons - a producer queueing messages of mixed sizes that a consumer frees in FIFO order */
+static void gen_prodcons(trace_t *t, size_t n)
+{
+    gen_t g;
+    unsigned int *queue, head = 0, tail = 0, qcap = 4096;
+
+    gen_start(&g, t, qcap);
+    queue = calloc(qcap, sizeof(unsigned int));
+    while (t->nops < n)
+    {
+        if (tail - head < qcap && (tail == head || rand() % 100 < 52))
+        {
+            unsigned int i = gen_alloc(&g, rand() % 8 ? uniform(64, 1024) : uniform(1024, 16384));
+            queue[tail++ % qcap] = g.live[i];
+        }
+        else
+        {
+            /*the oldest message is consumed: find its slot in live[]*/
+            unsigned int id = queue[head++ % qcap], i = 0;
+
+            while (g.live[i] != id)
+                i++;
+            gen_free(&g, i);
+        }
+    }
+    free(queue);
+    gen_end(&g);
+}
+
+/* gen_vector - dynamic arrays grown by realloc to 1.5 times their size, then dropped */
+static void gen_vector(trace_t *t, size_t n)
+{
+    gen_t g;
+    unsigned int i;
+    size_t size;
+
+    gen_start(&g, t, 64);
+    while (t->nops < n)
+    {
+        if (g.nfree > 0 && (g.nlive == 0 || rand() % 16 == 0))
+        {
+            gen_alloc(&g, uniform(8, 64));
+            continue;
+        }
+        i = uniform(0, g.nlive - 1);
+        size = g.size[g.live[i]];
+        if (size > (size_t)uniform(4096, 1 << 20))
+            gen_free(&g, i);
+        else
+        {
+            g.size[g.live[i]] = size + size / 2 + 8;
+            add_op(t, 'r', g.live[i], g.size[g.live[i]]);
+        }
+    }
+    gen_end(&g);
+}
+
+/* gen_powerlaw - Pareto-distributed sizes (mostly small, a heavy tail of large ones) and random lifetimes */
+static void gen_powerlaw(trace_t *t, size_t n)
+{
+    gen_t g;
+    double u, s;
+
+    gen_start(&g, t, 5000);
+    while (t->nops < n)
+    {
+        if (g.nfree > 0 && (g.nlive == 0 || rand() % 2))
+        {
+            u = ((double)rand() + 1) / ((double)RAND_MAX + 2);
+            s = 16.0 / pow(u, 1 / 1.1);
+            gen_alloc(&g, s > (4 << 20) ? (4 << 20) : (size_t)s);
+        }
+        else
+            gen_free(&g, uniform(0, g.nlive - 1));
+    }
+    gen_end(&g);
+}
+
+/* generate - build trace t with generator name, return 0 on success */
+static int generate(trace_t *t, const char *name, size_t n, unsigned int seed)
+{
+    srand(seed);
+    snprintf(t->name, sizeof(t->name), "gen:%s", name);
+    if (strcmp(name, "small") == 0)
+        gen_small(t, n);
+    else if (strcmp(name, "prodcons") == 0)
+        gen_prodcons(t, n);
+    else if (strcmp(name, "vector") == 0)
+        gen_vector(t, n);
+    else if (strcmp(name, "powerlaw") == 0)
+        gen_powerlaw(t, n);
+    else
+    {
+        fprintf(stderr, "mm_bench: unknown generator %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static unsigned long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* now_cycles - the time stamp counter, for -c */
+static unsigned long now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* check_block - with -v, check that block p of the given id still holds its fill pattern */
+static int check_block(unsigned char *p, size_t size, unsigned int id)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        if (p[i] != (unsigned char)id)
+            return -1;
+    return 0;
+}
+
+/*
+ * check_align - with -v, check at the start of a run that mm_memalign(BENCH_ALIGN, n) of the
+ * smallest sizes, which come from the slab front end, honours the alignment; -1 if not
+ */
+static int check_align(const char *name)
+{
+    void *p[64];
+    size_t i;
+    int bad = 0;
+
+    for (i = 0; i < 64; i++)
+        if ((p[i] = mm_memalign(BENCH_ALIGN, i % 8 + 1)) == NULL || (uintptr_t)p[i] % BENCH_ALIGN != 0)
+        {
+            fprintf(stderr, "%s: mm_memalign(%d, %zu) returned %p\n", name, BENCH_ALIGN, i % 8 + 1, p[i]);
+            bad = -1;
+        }
+    for (i = 0; i < 64; i++)
+        mm_free(p[i]);
+    return bad;
+}
+
+/* replay - run trace t on a fresh heap and measure it into r */
+static void replay(trace_t *t, result_t *r)
+{
+    char **ptr = calloc(t->nids, sizeof(char *));
+    size_t *size = calloc(t->nids, sizeof(size_t));
+    size_t *held = calloc(t->nids, sizeof(size_t)); /*the part of size that is in the heap*/
+    size_t live = 0, peak = 0, heap, i;
+    unsigned long t0, t1, c0 = 0, c1 = 0, total = 0;
+    op_t *op;
+    char *p;
+
+    r->secs = r->util = 0;
+    mem_reset_brk();
+    if (mm_init() < 0)
+    {
+        fprintf(stderr, "%s: mm_init failed\n", t->name);
+        r->failed = 1;
+        return;
+    }
+    r->failed = verify && check_align(t->name) < 0;
+    for (i = 0; i < t->nops && !r->failed; i++)
+    {
+        op = &t->ops[i];
+        if (verify && op->type != 'a' && ptr[op->id] != NULL
+            && check_block((unsigned char *)ptr[op->id], size[op->id], op->id) < 0)
+        {
+            fprintf(stderr, "%s: op %zu: block %u was overwritten\n", t->name, i, op->id);
+            r->failed = 1;
+            break;
+        }
+        t0 = now_ns();
+        if (cycles)
+            c0 = now_cycles();
+        switch (op->type)
+        {
+        case 'a':
+            p = mm_malloc(op->size);
+            break;
+        case 'r':
+            p = mm_realloc(ptr[op->id], op->size);
+            break;
+        default:
+            mm_free(ptr[op->id]);
+            p = NULL;
+            break;
+        }
+        if (cycles)
+            c1 = now_cycles();
+        t1 = now_ns();
+        r->lat[i] = cycles ? c1 - c0 : t1 - t0;
+        total += t1 - t0;
+
+        if (op->type != 'f' && op->size > 0 && p == NULL)
+        {
+            fprintf(stderr, "%s: op %zu: %s of %zu bytes failed\n", t->name, i,
+                    op->type == 'a' ? "malloc" : "realloc", op->size);
+            r->failed = 1;
+            break;
+        }
+        if (verify && op->type != 'f' && p != (char *)-1 && (uintptr_t)p % BENCH_ALIGN != 0)
+        {
+            fprintf(stderr, "%s: op %zu: block %p is not %d-byte aligned\n", t->name, i, (void *)p, BENCH_ALIGN);
+            r->failed = 1;
+            break;
+        }
+        live -= held[op->id];
+        size[op->id] = op->type == 'f' || p == (char *)-1 ? 0 : op->size;
+        ptr[op->id] = size[op->id] ? p : NULL;
+        held[op->id] = size[op->id] && p >= (char *)mem_heap_lo() && p <= (char *)mem_heap_hi() ? size[op->id] : 0;
+        live += held[op->id];
+        if (live > peak)
+            peak = live;
+        if (verify && size[op->id])
+            memset(p, (unsigned char)op->id, size[op->id]);
+    }
+    heap = (char *)mem_heap_hi() - (char *)mem_heap_lo() + 1;
+    r->secs = total / 1e9;
+    r->util = heap ? (double)peak / heap : 0;
+
+    /*whatever the trace left behind goes, so that no mapping outlives the run*/
+    for (i = 0; i < t->nids; i++)
+        if (ptr[i] != NULL)
+            mm_free(ptr[i]);
+    free(ptr);
+    free(size);
+    free(held);
+}
+
+static int cmp_ul(const void *x, const void *y)
+{
+    unsigned long a = *(const unsigned long *)x, b = *(const unsigned long *)y;
+
+    return a < b ? -1 : a > b;
+}
+
+/* report - print the line of trace t */
+static void report(trace_t *t, result_t *r)
+{
+    size_t n = t->nops;
+
+    qsort(r->lat, n, sizeof(unsigned long), cmp_ul);
+    printf("%-20s %9zu %10.0f %6.1f%% %7lu %7lu %7lu %7lu %9lu%s\n", t->name, n,
+           r->secs > 0 ? n / r->secs / 1000 : 0, 100 * r->util,
+           r->lat[n / 2], r->lat[n * 9 / 10], r->lat[n * 99 / 100], r->lat[n * 999 / 1000],
+           r->lat[n - 1], r->failed ? "  FAILED" : "");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mm_bench [-r reps] [-p first|next|best|aobf] [-M] [-v] [-c] [-n ops] [-s seed] [-o out] [-g small|prodcons|vector|powerlaw]... [trace]...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    trace_t *traces;
+    result_t r;
+    int c, i, rep, reps = 1, ntraces = 0, failed = 0;
+    size_t nops = DEFAULT_OPS;
+    unsigned int seed = 1;
+    char *out = NULL;
+
+    if ((traces = calloc(argc, sizeof(trace_t))) == NULL)
+        return 1;
+    while ((c = getopt(argc, argv, "r:p:Mvcn:s:o:g:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'p':
+            if (strcmp(optarg, "first") == 0)
+                mm_mallopt(MM_PLACEMENT, MM_FIRST_FIT);
+            else if (strcmp(optarg, "next") == 0)
+                mm_mallopt(MM_PLACEMENT, MM_NEXT_FIT);
+            else if (strcmp(optarg, "best") == 0)
+                mm_mallopt(MM_PLACEMENT, MM_BEST_FIT);
+            else if (strcmp(optarg, "aobf") == 0)
+                mm_mallopt(MM_PLACEMENT, MM_ADDR_BEST_FIT);
+            else
+                usage();
+            break;
+        case 'M':
+            mm_mallopt(MM_MMAP_THRESHOLD, 0);
+            break;
+        case 'v':
+            verify = 1;
+            break;
+        case 'c':
+#if defined(__x86_64__) || defined(__i386__)
+            cycles = 1;
+            break;
+#else
+            fprintf(stderr, "mm_bench: -c needs an x86 time stamp counter\n");
+            return 2;
+#endif
+        case 'n':
+            nops = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'g':
+            if (generate(&traces[ntraces], optarg, nops, seed) < 0)
+                return 2;
+            if (out != NULL && save_trace(&traces[ntraces], out) < 0)
+                return 1;
+            ntraces++;
+            break;
+        default:
+            usage();
+        }
+    }
+    for (i = optind; i < argc; i++)
+        if (load_trace(&traces[ntraces++], argv[i]) < 0)
+            return 1;
+    if (ntraces == 0 || reps < 1)
+        usage();
+
+    mem_init();
+    printf("%-20s %9s %10s %7s %7s %7s %7s %7s %9s\n", "trace", "ops", "Kops/s", "util",
+           cycles ? "p50cy" : "p50ns", cycles ? "p90cy" : "p90ns", cycles ? "p99cy" : "p99ns",
+           cycles ? "p999cy" : "p999ns", cycles ? "maxcy" : "maxns");
+    for (i = 0; i < ntraces; i++)
+    {
+        if (traces[i].nops == 0)
+            continue;
+        r.lat = calloc(traces[i].nops, sizeof(unsigned long));
+        for (rep = 0; rep < reps; rep++)
+            replay(&traces[i], &r);
+        report(&traces[i], &r);
+        failed |= r.failed;
+        free(r.lat);
+    }
+    return failed;
+}
@@ -0,0 +1,176 @@
+/*
+ * mm_ext.h - extensions to the mm.h interface of the allocator in mm.c
+ */
+#ifndef MM_EXT_H
+#define MM_EXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Parameters for mm_mallopt */
+#define MM_MMAP_THRESHOLD 1 /*requests of at least this many bytes get their own mapping, 0 turns it off*/
+#define MM_TRIM_THRESHOLD 2 /*free blocks of at least this many bytes give their pages back, 0 turns it off*/
+#define MM_PLACEMENT 3 /*placement policy, one of the values below*/
+#define MM_FAST_MAX 4 /*freed blocks of at most this many bytes are coalesced later, 0 (default) frees at once*/
+#define MM_GROW_MAX 5 /*cap of the heap growth step, which doubles from 4 KiB (1 MiB by default, 0 keeps it at 4 KiB)*/
+#define MM_PREFAULT 6 /*non-zero: fault in new heap pages as the heap grows*/
+#define MM_HUGEPAGE 7 /*non-zero, before mm_init: lay the heap out in 2 MiB transparent huge pages*/
+#define MM_GUARD_RATE 8 /*one request of at most a page in about this many gets a guarded page (needs MM_GUARD), 0 for none*/
+#define MM_PROF_RATE 9 /*mean bytes allocated between heap-profile samples, 512 KiB by default (needs MM_PROF), 0 for none*/
+
+/* Placement policies */
+#define MM_FIRST_FIT 0 /*first block of the size class that fits (default)*/
+#define MM_NEXT_FIT 1 /*first fit from where the last search of the class stopped*/
+#define MM_BEST_FIT 2 /*smallest block of the size class that fits*/
+#define MM_ADDR_BEST_FIT 3 /*best fit, ties going to the lowest address*/
+
+/* mm_mallopt - set an allocator parameter, return 1 on success and 0 for a bad parameter or value */
+int mm_mallopt(int param, long value);
+
+/* Figures of mm_get_stats; the counters are only kept when mm.c is built with MM_STATS */
+#define MM_FIT_BUCKETS 8
+struct mm_stats {
+    size_t heap_bytes;          /*size of the sbrk heap*/
+    size_t free_bytes;          /*bytes in free heap blocks*/
+    size_t free_blocks;
+    size_t largest_free;        /*size of the largest free heap block*/
+    double fragmentation;       /*1 - largest_free / free_bytes*/
+
+    size_t live_bytes;          /*bytes in blocks handed out and not freed, headers included*/
+    size_t mapped_bytes;        /*bytes in the private mappings of huge blocks*/
+    unsigned long mallocs;      /*calls*/
+    unsigned long frees;
+    unsigned long reallocs;
+    unsigned long tcache_hits;  /*requests served from a thread cache without a lock*/
+    unsigned long fit_searches; /*free-block searches and the blocks they looked at*/
+    unsigned long fit_probes;
+    unsigned long fit_misses;   /*searches that found nothing and grew the heap*/
+    unsigned long fit_hist[MM_FIT_BUCKETS]; /*searches that looked at 0, 1, 2-3, 4-7, ... blocks*/
+    unsigned long extend_calls; /*times an arena grew the heap*/
+    unsigned long realloc_in_place; /*reallocs that stayed put, within the block or into the free block after it*/
+    unsigned long realloc_shrink;   /*reallocs that gave the tail of the block back*/
+    unsigned long realloc_move_back; /*reallocs that slid the block down into a free predecessor*/
+    unsigned long realloc_extend;   /*reallocs that grew the heap under the block*/
+    unsigned long realloc_mremap;   /*reallocs of huge blocks moved by the kernel*/
+    unsigned long realloc_copy;     /*reallocs that copied to a new block*/
+    unsigned long remote_frees;     /*frees queued lock-free for the arena of another thread*/
+    unsigned long guarded;          /*requests sampled into a guarded page*/
+};
+
+/* mm_get_stats - fill st with the current figures, return 1 if the counters are kept and 0 if they are all zero */
+int mm_get_stats(struct mm_stats *st);
+
+/*
+ * Trace files of mm_trace_start: a struct mm_trace_hdr, then fixed-size records in the order
+ * the rings were written out, each ring in the order of its thread; sort them by ts to replay.
+ */
+#define MM_TRACE_MAGIC "mmtrace"
+#define MM_TRACE_VERSION 1
+#define MM_TRACE_MALLOC 'm'
+#define MM_TRACE_FREE 'f'
+#define MM_TRACE_REALLOC 'r'
+
+struct mm_trace_hdr {
+    char magic[8];              /*MM_TRACE_MAGIC, NUL-terminated*/
+    uint32_t version;
+    uint32_t rec_size;          /*sizeof(struct mm_trace_rec)*/
+};
+
+struct mm_trace_rec {
+    uint64_t ts;                /*nanoseconds since mm_trace_start: after malloc and realloc, before free*/
+    uint64_t size;              /*bytes requested, 0 for free*/
+    uint64_t ptr;               /*block returned by malloc or realloc, or freed; 0 for a realloc to size 0*/
+    uint64_t old;               /*realloc: the block it was given*/
+    uint32_t tid;               /*thread, numbered from 1 by its first record*/
+    uint8_t op;                 /*MM_TRACE_MALLOC, MM_TRACE_FREE or MM_TRACE_REALLOC*/
+    uint8_t pad[3];
+};
+
+/* mm_trace_start - record every malloc, free and realloc to path (needs MM_TRACE), return 0 on success */
+int mm_trace_start(const char *path);
+
+/* mm_trace_stop - stop recording and finish the file, return 0 on success */
+int mm_trace_stop(void);
+
+/* mm_check_fn - told of every violation the incremental checker finds, with the block or list entry at fault */
+typedef void (*mm_check_fn)(void *arg, const void *addr, const char *what);
+
+/* mm_check_step - check the next blocks blocks of the heap, resuming where the last step stopped; return the violations found */
+int mm_check_step(size_t blocks, mm_check_fn report, void *arg);
+
+/* mm_check_every - run mm_check_step(blocks, report, arg) after every ops mallocs and frees of a thread, 0 turns it off */
+void mm_check_every(unsigned long ops, size_t blocks, mm_check_fn report, void *arg);
+
+/* mm_prof_dump - write the sampled live bytes by allocation stack to path as a pprof heap profile (needs MM_PROF), 0 on success */
+int mm_prof_dump(const char *path);
+
+/* A handle to a block that mm_compact may move: pin it to reach the block, 0 is no handle */
+typedef size_t mm_handle_t;
+
+/* mm_halloc - size bytes reached through a handle, 0 if out of memory */
+mm_handle_t mm_halloc(size_t size);
+
+/* mm_hpin - the payload of h, kept in place until the matching mm_hunpin; pins nest; NULL for a freed handle */
+void *mm_hpin(mm_handle_t h);
+
+/* mm_hunpin - drop a pin of h, after which the pointer mm_hpin returned may go stale */
+void mm_hunpin(mm_handle_t h);
+
+/* mm_hfree - free h and its block */
+void mm_hfree(mm_handle_t h);
+
+/* mm_compact - move unpinned handle blocks down the heap, at most max_bytes of them (0 for all), and release the freed top pages; return the bytes moved */
+size_t mm_compact(size_t max_bytes);
+
+/* mm_malloc_onnode - mm_malloc from the arena of NUMA node node (needs MM_NUMA, else any node is mm_malloc); NULL for an unknown node */
+void *mm_malloc_onnode(size_t size, int node);
+
+/* mm_heap_file - have the next mm_init map the heap from path instead of sbrk (needs MM_PERSIST), NULL for sbrk; 0 on success */
+int mm_heap_file(const char *path);
+
+/* mm_snapshot - sync the file heap to disk for the next mm_init to reattach, return 0 on success */
+int mm_snapshot(void);
+
+/* mm_set_root - remember block ptr in the heap for mm_get_root, saved by mm_snapshot */
+void mm_set_root(void *ptr);
+
+/* mm_get_root - the block of the last mm_set_root, or of the snapshot mm_init reattached; NULL for none */
+void *mm_get_root(void);
+
+/* mm_trim - give the pages of free heap blocks back to the OS, keeping pad bytes at the top; return 1 if any memory was released */
+int mm_trim(size_t pad);
+
+/* mm_memalign - size bytes at a multiple of alignment, a power of two; NULL if alignment is not valid */
+void *mm_memalign(size_t alignment, size_t size);
+
+/* mm_aligned_alloc - C11 aligned_alloc, the same as mm_memalign */
+void *mm_aligned_alloc(size_t alignment, size_t size);
+
+/* mm_malloc_batch - allocate up to n blocks of size bytes into out, return how many were allocated */
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+/* mm_free_batch - free the n blocks of ptrs, NULL entries included; the array is sorted by address */
+void mm_free_batch(void **ptrs, size_t n);
+
+/* mm_free_sized - mm_free for a block whose size is known, between the size asked for and mm_usable_size */
+void mm_free_sized(void *ptr, size_t size);
+
+/* mm_usable_size - bytes of ptr that may be used, at least the size it was allocated with; 0 for NULL */
+size_t mm_usable_size(void *ptr);
+
+/* A region: bump allocation from large heap chunks, all freed together; not safe to share between threads */
+struct mm_region;
+
+/* mm_region_create - a new region allocating chunk_size bytes at a time (0 for the default), NULL if out of memory */
+struct mm_region *mm_region_create(size_t chunk_size);
+
+/* mm_region_alloc - size bytes from r with mm_malloc's alignment, NULL for 0 bytes or if out of memory */
+void *mm_region_alloc(struct mm_region *r, size_t size);
+
+/* mm_region_reset - free everything allocated from r, which stays usable */
+void mm_region_reset(struct mm_region *r);
+
+/* mm_region_destroy - free r and everything allocated from it */
+void mm_region_destroy(struct mm_region *r);
+
+#endif /* MM_EXT_H */